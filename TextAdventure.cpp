@@ -9,30 +9,115 @@ DOCUMENTATION
 Program Purpose:
     This program is a text-based adventure game. The player is Alice, who has fallen into a rabbit hole and must find her way to wonderland.
     
-Compile: (assuming Cygwin is running): g++ -o Alice Alice.cpp
-Execution: (assuming Cygwin is running): ./Alice.exe
+Compile: (assuming Cygwin is running): g++ -std=c++17 -pthread -o Alice Alice.cpp
+Test: make check builds the game and replays the scripts in tests/, then builds it with -DCOUNT_ALLOCATIONS and runs
+    --check-allocations, failing if starting a game or a turn allocates memory
+Execution: (assuming Cygwin is running): ./Alice.exe [--world <world file or image>]
+Compile a world: ./Alice.exe --compile world.txt world.img writes the world as an image, which is mapped into memory and
+    played where it is instead of being read (a world file is compiled in memory each time it is played)
+Replay: ./Alice.exe --replay [--record] [--world <file>] <script or directory>... plays each script of commands in the default
+    world (or the world file) and compares its output with <script>.golden
+    (--record writes the golden transcript of a script that has none; ./Alice.exe --replay tests checks the game;
+    a script's own <script>.world is played instead, and a <script>.journal is resumed before the script and after it)
+Solve: ./Alice.exe --solve [world file] prints the shortest list of commands that wins the world
+Generate: ./Alice.exe --generate <rooms> [seed] [items] [characters] [connectivity] [wanderers] > world.txt writes a generated world
+Save: ./Alice.exe --journal save.txt keeps the game in save.txt (and save.txt.checkpoint) and resumes it on the next run
+Statistics: ./Alice.exe --stats stats.txt writes the statistics the 'stats' command shows to stats.txt every 10 seconds
+    and when the game ends; they are those of every session of the process, so --serve takes --stats as well
+    (compile with -DNO_METRICS to leave the statistics out of the game)
+Allocations: ./Alice.exe --check-allocations [rounds] plays rounds of every kind of command and fails if starting the game in
+    the default world or a turn allocates memory
+    (the allocations are only counted in a game compiled with -DCOUNT_ALLOCATIONS, which replaces operator new)
+Serve: ./Alice.exe --serve /tmp/alice.sock [--world <file or image>] [--shared | --journals <directory>] [--stats <file>] plays
+    a game for each player who connects to the local socket (with socat - UNIX-CONNECT:/tmp/alice.sock, say), until it is
+    stopped with Ctrl-C. Each player has the world to themselves, unless --shared puts them all in one world where they
+    see what the others take and leave (with --journals, the first line a player sends names their game, which is saved
+    in the directory and resumed when they connect with the name again)
+Benchmark: ./Alice.exe --bench 10 1000 100000 measures command parsing and moving 200000 wandering characters, then compiling, loading, memory, commands,
+    rendering, players sharing a world and the memory of 10000 sessions on generated worlds
+    (a million rooms compiles in about 19 seconds and loads from its image in about 30 ms, at under 150 bytes a room,
+    of which its text takes about 50, compressed from about 250)
+Parser benchmark: ./Alice.exe --bench-parser [commands] times parsing commands the way the original game did (copying them),
+    by comparing their words with each keyword in turn, and by the table of keywords the game uses now
 
-Classes: Location, Item, Character, Control, Game
+Classes: Item, Inventory, Character, Location, TextPool, WorldCompiler, World, RoomItems, WorkerPool, WorldChanges, Control, Game, Server, Metrics, StatsWriter, AssetCache, Replay, Solver, Generator, Benchmark, AllocationCheck
+
+Threads:
+    Each Control is one player, and is only ever used by one thread at a time. A World never changes once it is loaded,
+    so it is read without locks; what players change is kept in a WorldChanges. A Control either loads a World and
+    WorldChanges of its own (as the game and --replay do, with one Control per core) or joins the WorldChanges of a
+    world that players on other threads share (as --bench and --serve --shared do). Shared changes are split between 64 shards by room
+    index, and each shard has a lock that a player holds while they look at a room of the shard or change it, so players
+    in different shards never wait for each other. A wandering character moves while holding the locks of the shards of
+    both rooms, and a player never holds two. A world with many wandering characters moves them in batches on a
+    WorkerPool, with a thread for each core, whose batches take the same locks. Only a game with changes of its own can
+    be saved. The AssetCache, shared by every Control, has its own lock. Each thread counts the operations it times in
+    Metrics of its own, which the stats command and the StatsWriter's thread sum without stopping it.
+    The server (--serve) loads one World for all its sessions, and gives each session a Control with changes of its own.
+    Its connections are handed round robin to a worker thread per core, which plays them from its own epoll; a session
+    is only played by its worker, so the sessions share nothing but the World and the AssetCache. A shared server
+    (--serve --shared) gives every session one WorldChanges instead, and each of its shards belongs to one worker, which
+    plays every session whose player is in a room of the shard; a player who walks into another worker's shard has their
+    session handed to that worker through a lock-free stack. The shards keep their locks, since wandering characters
+    move between shards from whichever session ticks them, and the --bench players share the world without workers.
+    The Solver (--solve) expands each level of its search in batches on the WorkerPool; a batch only reads the states
+    found so far, and the new states are then kept one partition of the table per task, so no locks are needed.
+    The shards are meant to let a shared world scale with the cores; --bench prints the commands a second of players on
+    1, 2, 4 and more threads sharing a world, and how far that is from linear, for the cores of the machine it runs on
+    (it has only been run on a machine with one core, where more threads can only take turns).
 
 Variables:
 Item class:
-    string name - name of the item
+    uint32_t name - symbol of the name of the item
+
+Character (a record of a world image):
+    uint32_t name - symbol of the name of the character
+    uint32_t dialogue - number of the text of the dialogue with the character
+    uint32_t room - the room the character is in when the game begins
+
+Location (a record of a world image):
+    uint32_t description - number of the text of the description of the room
+    uint32_t exits[DirectionCount] - the room reached by each compass direction, or NO_ROOM if there is no path
+    uint32_t firstItem, firstCharacter, firstTrigger - where the room's items, characters and triggers start in their tables
+
+World class:
+    uint32_t start - the room every player starts in, from the header of the world image (which is mapped from its file,
+        compiled in memory, or for the default world BUILTIN_IMAGE, compiled with the game)
+    Span<Location> rooms - the rooms, and one more that ends the last room's items, characters and triggers
+    Span<uint32_t> items - the symbol of each item, grouped by room
+    Span<Symbol> symbols, Span<uint32_t> symbolSlots - every name in the world, and a hash table to find them by text
+    Span<Trigger> triggers, Span<Instruction> instructions - what happens when the player talks, takes, enters or stays
+    Span<TextRecord> texts - the room descriptions, dialogue and lines of the world, each stored once, in blocks that are
+        compressed in the image
+    BlockCache blockCache - the blocks of texts that were shown most recently, decompressed and shared by every player
 
-Character class:
-    string name - name of the character
-    string dialogue - dialogue with the character
+WorldChanges class:
+    Shard shards[] - for each shard of the rooms, its lock, the items of its rooms that players have changed, and the
+        rooms of it that were rendered most recently, each shared by every player who is shown the room as it is
+    vector<atomic<uint32_t>> wandererRooms, wandererStays, wandererItems - for each wandering character (an array for
+        each, so a tick only touches what it moves), the room they are in, the ticks they stay there and what they carry
+    vector<uint32_t> firstOccupant, nextOccupant, previousOccupant - the wanderers in each room, as a list for each room
 
-Location class:
-    string description - description of the room
-    vector<Item> items - vector of items in the room
-    map<string, Location*> directions - map of directions the player can move in the room
-    vector<Character> characters - vector of characters in the room
+Server class:
+    const World& world - the world every session plays, loaded once
+    optional<WorldChanges> sharedChanges - the changes every session plays, with --shared
+    string journalDirectory - where the sessions' games are saved, each in a journal named after the game
+    unordered_set<string> playing - the names of the saved games being played, so that each is played by one session
+    vector<Worker> workers - for each worker thread, its epoll, the connections handed to it, and its sessions
+        (each a Control, with the output the socket has not taken yet and the part of a line the player has sent), and
+        the sessions of the shared world other workers have handed it
 
 Control class:
-    string input - input from the user
-    vector<string> words - vector of words from the user's input
-    string command - the command the user wants to execute
-    string argument - the argument for the command    
+    const World& world, WorldChanges& changes - the world the player is in and the changes made to it, owned by the
+        Control (optional<World> ownWorld, optional<WorldChanges> ownChanges) unless they are shared
+    uint32_t currentRoom - the index of the room the player is in
+    shared_ptr<const string> shown - the player's room as it was last shown, held until it has been written out
+    istream& input, ostream& output - where this session reads commands and writes the game
+    string action - the line the player typed, read into the same string every turn
+    Inventory inventory - the item the player is carrying, if any
+    bool gameOver - set when the player wins or dies, which ends only this session
+    shared_ptr<const string> instructions - the instructions, shared with every other session through the AssetCache
+    ofstream journal - the commands that changed the game since the last checkpoint, when the game is being saved
 */
 /*
 TEST PLAN
@@ -93,404 +178,5667 @@ Characters in the room: hatter dutchess queen rabbit
 
 #include <iostream> // input/output stream
 #include <string> // string library (getline, etc...)
-#include <map> // map library (used for rooms)
 #include <vector> // vector library (used for items)
 #include <algorithm> //algorithm library (for transform, find_if)
 #include <fstream> // file stream
+#include <sstream> // string stream (used to read the world)
+#include <unordered_map> // unordered map library (used to find rooms by name)
+#include <unordered_set> // unordered set library (used to remember which rooms have changed)
+#include <map> // map library (used by the solver to search states in order of how few commands they could win in)
+#include <numeric> // iota (used by the solver to order the states waiting to be searched)
+#include <deque> // deque library (used to keep texts and triggers in place while a world is compiled)
+#include <list> // list library (used to keep the decompressed blocks of texts in the order they were used)
+#include <string_view> // string view (used to read commands without copying them)
+#include <iterator> // size (used for the tables of the default world)
+#include <utility> // exchange (used to walk the sessions handed between the server's workers)
+#include <array> // array (used for the table of the words the parser knows)
+#include <filesystem> // filesystem library (used to find replay scripts)
+#include <chrono> // clocks (used to time replayed commands)
+#include <thread> // threads (used to play replay scripts in parallel)
+#include <atomic> // atomic counter (used to hand out replay scripts to threads)
+#include <mutex> // mutex (used to share the text files between sessions)
+#include <condition_variable> // condition variable (used to hand work to the worker pool)
+#include <memory> // shared pointers (used to share the text files between sessions)
+#include <optional> // optional (used to hold the world and changes a session plays alone)
+#include <cstdint> // fixed width integers (used by the solver's states)
+#include <random> // random numbers (used to generate worlds)
+#include <new> // memory allocation (counted to check that turns do not allocate, with -DCOUNT_ALLOCATIONS)
+#include <cstdlib> // malloc and free (used by the counted allocations)
+#include <cmath> // ceil (used for percentiles)
+#include <cstring> // memcpy (used to lay out world images)
+#include <stdexcept> // logic_error (thrown if the world compiler makes an image it cannot play)
+#include <fcntl.h> // open (used to map world images)
+#include <sys/mman.h> // mmap (used to map world images)
+#include <sys/stat.h> // fstat (used to map world images)
+#include <unistd.h> // close (used to map world images)
+#ifdef __GLIBC__
+#include <malloc.h> // mallinfo2 (used to measure the memory of sessions)
+#endif
+#ifdef __linux__
+#include <cerrno> // errno (used by the server)
+#include <csignal> // sigaction (used to stop the server)
+#include <sys/epoll.h> // epoll (used by the server's workers to wait for their sessions)
+#include <sys/eventfd.h> // eventfd (used to wake the server's workers)
+#include <sys/socket.h> // sockets (used by the server)
+#include <sys/un.h> // local sockets (used by the server)
+#endif
 
 using namespace std; // standard namespace
 
+#ifdef COUNT_ALLOCATIONS
 /*
-Item class represents an item in the game
+Compiling with -DCOUNT_ALLOCATIONS counts every memory allocation for the thread that makes it, so --check-allocations
+can show that playing a turn allocates nothing. The game itself is built without it and keeps the usual allocator.
+The array and nothrow forms of new come here through these, and the aligned forms are counted as well
 */
-class Item {
-public:
-    Item(const string& name) : name(name) {} // Constructor
+thread_local size_t allocationCount = 0;
+
+/*
+The replacements are kept out of line: inlined into their callers, GCC would see malloc() or free() on one side and
+operator new or delete on the other, and warn that they do not match
+*/
+#if defined(__GNUC__)
+#define OUT_OF_LINE __attribute__((noinline))
+#else
+#define OUT_OF_LINE
+#endif
 
-    string getName() const {
-        return name; // Returns the name of the item
+OUT_OF_LINE void* operator new(size_t size) {
+    allocationCount++;
+    if (void* memory = malloc(size != 0 ? size : 1)) {
+        return memory;
     }
+    throw bad_alloc();
+}
 
-private:
-    string name; // Name of the item
+OUT_OF_LINE void* operator new(size_t size, align_val_t alignment) {
+    allocationCount++;
+    size_t align = static_cast<size_t>(alignment);
+    size_t rounded = (max<size_t>(size, 1) + align - 1) / align * align; // aligned_alloc needs a whole number of alignments
+    if (void* memory = aligned_alloc(align, rounded)) {
+        return memory;
+    }
+    throw bad_alloc();
+}
+
+OUT_OF_LINE void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+OUT_OF_LINE void operator delete(void* memory, size_t) noexcept {
+    free(memory);
+}
+
+OUT_OF_LINE void operator delete(void* memory, align_val_t) noexcept {
+    free(memory);
+}
+
+OUT_OF_LINE void operator delete(void* memory, size_t, align_val_t) noexcept {
+    free(memory);
+}
+#endif
+
+/*
+Commands are plain ASCII, so case and spaces are worked out here rather than through the locale that
+tolower and isspace look up on every character (the game never changes it from the "C" locale, where they agree)
+*/
+constexpr char lowerCase(char letter) {
+    return letter >= 'A' && letter <= 'Z' ? static_cast<char>(letter - 'A' + 'a') : letter;
+}
+
+bool isSpace(char letter) {
+    return letter == ' ' || (letter >= '\t' && letter <= '\r'); // A space, tab, line break, vertical tab, form feed or carriage return
+}
+
+// Compares two strings ignoring case, without making lowercase copies of either
+bool equalsIgnoreCase(string_view a, string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (lowerCase(a[i]) != lowerCase(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Removes the spaces at the start and end of the text
+string_view trim(string_view text) {
+    while (!text.empty() && isSpace(text.front())) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && isSpace(text.back())) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+/*
+A command is the player's input split into a verb and the word it acts on (an item, a character or a direction)
+*/
+enum class Verb { Move, Take, Leave, Talk, Stats };
+
+struct Command {
+    Verb verb;
+    string_view argument; // Points into the player's input, so it is only valid until the next line is read
 };
 
-// Class representing a character
-class Character {
-public:
-    // Constructors for the Character class
-    Character(const string& name, const string& dialogue)
-        : name(name), dialogue(dialogue) {}
+/*
+The compass directions a room can have a path in. They are kept in alphabetical order, which is the order the paths are displayed in
+*/
+enum Direction { East, North, South, West, DirectionCount };
+constexpr string_view DIRECTION_NAMES[DirectionCount] = {"east", "north", "south", "west"};
+
+/*
+Every word the parser knows: the verbs, and the directions in full and by their first letter. They are laid out in
+KEYWORD_TABLE when the game is compiled, each in the slot keywordSlot works out from its length and its first and last
+letters. No two keywords share a slot (which the static_assert below checks), so a word is looked up with one hash and
+one comparison, however many keywords there are
+*/
+struct Keyword {
+    string_view text; // In lowercase; an empty slot has no text, so no word matches it
+    Verb verb; // Verb::Move for a direction
+    Direction direction; // DirectionCount for a verb
+};
+
+constexpr Keyword KEYWORDS[] = {
+    {"take", Verb::Take, DirectionCount}, {"leave", Verb::Leave, DirectionCount}, {"talk", Verb::Talk, DirectionCount},
+    {"stats", Verb::Stats, DirectionCount},
+    {"east", Verb::Move, East}, {"e", Verb::Move, East}, {"north", Verb::Move, North}, {"n", Verb::Move, North},
+    {"south", Verb::Move, South}, {"s", Verb::Move, South}, {"west", Verb::Move, West}, {"w", Verb::Move, West},
+};
+constexpr size_t KEYWORD_SLOTS = 16;
+
+constexpr size_t keywordSlot(string_view word) { // The word is never empty
+    return (lowerCase(word.front()) * 4 + lowerCase(word.back()) + word.size() * 15) % KEYWORD_SLOTS;
+}
+
+constexpr array<Keyword, KEYWORD_SLOTS> layOutKeywords() {
+    array<Keyword, KEYWORD_SLOTS> table{};
+    for (const auto& keyword : KEYWORDS) {
+        table[keywordSlot(keyword.text)] = keyword;
+    }
+    return table;
+}
+
+constexpr array<Keyword, KEYWORD_SLOTS> KEYWORD_TABLE = layOutKeywords();
+
+constexpr bool keywordsHaveSlotsOfTheirOwn() {
+    for (const auto& keyword : KEYWORDS) {
+        if (KEYWORD_TABLE[keywordSlot(keyword.text)].text != keyword.text) {
+            return false;
+        }
+    }
+    return true;
+}
+static_assert(keywordsHaveSlotsOfTheirOwn(), "Two keywords share a slot of KEYWORD_TABLE; change the multipliers of keywordSlot");
+
+// Finds the keyword the word is, ignoring case, or returns nullptr if it is not one
+const Keyword* findKeyword(string_view word) {
+    if (word.empty()) {
+        return nullptr;
+    }
+    const Keyword& keyword = KEYWORD_TABLE[keywordSlot(word)];
+    return equalsIgnoreCase(word, keyword.text) ? &keyword : nullptr;
+}
 
-    string getName() const {
-        return name; // Returns the name of the character
+/*
+Reads the verb from the player's input in one pass; anything that is not take, leave, talk or stats is a direction.
+The verb is matched ignoring case, and extra spaces around the verb and argument are ignored
+*/
+Command parseCommand(string_view action) {
+    action = trim(action);
+    size_t space = 0; // Found with a loop, as find_first_of looks for each of its characters in turn and takes longer than the rest of parsing
+    while (space < action.size() && action[space] != ' ' && action[space] != '\t') {
+        space++;
+    }
+    if (space == action.size()) {
+        space = string_view::npos;
     }
+    const Keyword* keyword = findKeyword(action.substr(0, space));
+    if (keyword != nullptr && keyword->verb != Verb::Move) {
+        if (keyword->verb == Verb::Stats) {
+            if (space == string_view::npos) {
+                return {Verb::Stats, string_view()};
+            }
+        } else if (space != string_view::npos) { // A verb always needs something to act on
+            return {keyword->verb, trim(action.substr(space))};
+        }
+    }
+    return {Verb::Move, action};
+}
+
+// Finds the direction the player typed, in full or by its first letter, ignoring case; returns DirectionCount if it is not a direction
+Direction parseDirection(string_view text) {
+    const Keyword* keyword = findKeyword(text);
+    return keyword != nullptr ? keyword->direction : DirectionCount;
+}
+
+/*
+Every name in a world (of an item or character) is interned when the world is compiled, and is known from then on by
+its symbol, the index of the name in the world's table of names. NO_SYMBOL is no name at all. Rooms are known by their
+index, and NO_ROOM is no room; wandering characters by the order of their wander lines, and NO_WANDERER is a character
+who stays where they are
+*/
+constexpr uint32_t NO_SYMBOL = UINT32_MAX;
+constexpr uint32_t NO_ROOM = UINT32_MAX;
+constexpr size_t NO_WANDERER = SIZE_MAX;
+
+/*
+Item class represents an item in the game
+*/
+class Item {
+public:
+    explicit Item(uint32_t name) : name(name) {} // Constructor
+
+    // Items are moved between the room and the inventory, never copied
+    Item(Item&&) = default;
+    Item& operator=(Item&&) = default;
+    Item(const Item&) = delete;
+    Item& operator=(const Item&) = delete;
 
-    string getDialogue() const {
-        return dialogue; // Returns the dialogue with the character
+    uint32_t getName() const {
+        return name; // Returns the symbol of the item's name
     }
 
 private:
-    string name;
-    string dialogue;
+    uint32_t name; // Symbol of the name of the item
 };
 
 /*
-This class represents a location, or room, in the game
+Inventory holds the items the player carries. The player can only carry one item at a time, so the inventory keeps
+that item itself, and taking and leaving items never allocate memory
 */
-class Location {
+class Inventory {
 public:
-    // Constructor for the Location class
-    Location(const string& description)
-        : description(description) {}
+    static constexpr size_t CAPACITY = 1;
 
-    // direction is the direction the player wants to move
-    void addDirection(const string& direction, Location* nextLocation) {
-        directions[direction] = nextLocation; // on the map, the direction is mapped to the next location
+    bool empty() const {
+        return count == 0;
     }
 
-    // itemName is the name of the item to add to the room
-    void addItem(const string& itemName) {
-        items.push_back(Item(itemName)); // if the item is in the room, add it to the vector of items
+    size_t size() const {
+        return count;
     }
 
-    // name is the name of the character to add to the room
-    void addCharacter(const string& name, const string& dialogue) {
-        characters.emplace_back(name, dialogue); // if the character is in the room, add it to the vector of characters along with their dialogue
+    Item* begin() {
+        return items;
     }
 
-    //Displays the room's description, items, and directions that the player can move
-    void display() const {
-        cout << "---------------------------------------------\n";
-        cout << description << endl;
-        if (!items.empty()) {
-            cout << "You see the following items in the room:\n";
-            for (const auto& item : items) { // for each item in the vector of items
-                cout << "- " << item.getName() << endl; // print the item
-            }
-        }
-        cout << "Available directions: ";
-        for (const auto& direction : directions) { // for each direction in the map of directions
-            cout << direction.first << " "; // print the direction
-        }
-        cout << endl;
-        cout << "Characters in the room: ";
-        for (const auto& character : characters) { // for each character in the vector of characters
-            cout << character.getName() << " "; // print the character
-        }
-        cout << endl; // new line
-        cout << "---------------------------------------------\n";
+    Item* end() {
+        return items + count;
     }
 
-    /*
-    Move is used to move the player to the next location
-    */
-    Location* move(const string& direction, const vector<Item>& inventory) const {
-    auto it = findDirection(direction); // find the direction in the map of directions
-    if (it != directions.end()) {
-        return it->second;
-    } else {
-        cout << "Invalid direction. Please enter north, east, south, or west.\n";
-        return nullptr;
+    const Item* begin() const {
+        return items;
     }
-}
-  
-    /*
-    Used to take an item from the room and add it to the player's inventory
-    */
-    bool takeItem(const string& itemName, vector<Item>& inventory) {
-        auto it = find_if(items.begin(), items.end(), [&](const Item& item) { // find the item in the vector of items
-            return item.getName() == itemName; // if the item is found, return the item
-        });
 
-        if (it != items.end()) { // if the item is in the room
-            inventory.push_back(*it); // add the item to the player's inventory
-            items.erase(it); // remove the item from the room
-            return true;
-        }
+    const Item* end() const {
+        return items + count;
+    }
 
-        return false; // if the item is not in the room, return false
+    const Item& front() const {
+        return items[0];
     }
 
-    /*
-    Used to leave an item in the room and remove it from the player's inventory
-    */
-    bool leaveItem(const string& itemName, vector<Item>& inventory) {
-        auto it = find_if(inventory.begin(), inventory.end(), [&](const Item& item) { // find the item in the player's inventory
-            return item.getName() == itemName; // if the item is found, return the item
-        });
+    const Item& back() const {
+        return items[count - 1];
+    }
 
-        if (it != inventory.end()) { // if the item is in the player's inventory
-            items.push_back(*it); // add the item to the room
-            inventory.erase(it); // remove the item from the player's inventory
-            return true;
-        }
+    // Adds an item; the caller makes sure the player has room for it
+    void push_back(Item&& item) {
+        items[count++] = std::move(item);
+    }
 
-        return false;
+    void erase(Item* item) {
+        move(item + 1, end(), item);
+        count--;
     }
 
-    const vector<Character>& getCharacters() const {
-        return characters;
+    void clear() {
+        count = 0;
     }
 
 private:
-    map<string, Location*>::const_iterator findDirection(const string& direction) const {
-        // Convert the input direction to lowercase for case-insensitive comparison
-        string lowerDirection = direction;
-        transform(lowerDirection.begin(), lowerDirection.end(), lowerDirection.begin(), ::tolower);
+    Item items[CAPACITY] = {Item(NO_SYMBOL)};
+    size_t count = 0;
+};
 
-        // Check if the input direction matches any full direction or single-letter abbreviation
-        for (auto it = directions.begin(); it != directions.end(); ++it) {
-            string lowerKey = it->first;
-            transform(lowerKey.begin(), lowerKey.end(), lowerKey.begin(), ::tolower);
-            if (lowerDirection == lowerKey || (lowerDirection.length() == 1 && lowerDirection[0] == lowerKey[0])) {
-                return it;
-            }
-        }
+/*
+Character is how a character is kept in a compiled world: the symbol of their name, the number of the text of their
+dialogue, and the room they are in when the game begins
+*/
+struct Character {
+    uint32_t name;
+    uint32_t dialogue;
+    uint32_t room;
+};
 
-        return directions.end();
+/*
+Location is how a room is kept in a compiled world: the number of the text of its description, the room each compass
+direction leads to (NO_ROOM if there is no path), and where the room's items, characters and triggers start in the
+world's tables. They end where the next room's start, so a world has one more Location than it has rooms. A room has
+no name once the world is compiled; the names are only needed to join the rooms up while the world file is read
+*/
+struct Location {
+    uint32_t description;
+    uint32_t exits[DirectionCount];
+    uint32_t firstItem;
+    uint32_t firstCharacter;
+    uint32_t firstTrigger;
+};
+
+/*
+A run of records in one of the tables of a world, which it only looks at
+*/
+template <typename Record>
+struct Span {
+    const Record* first = nullptr;
+    const Record* last = nullptr;
+
+    const Record* begin() const {
+        return first;
     }
 
-    /*
-    The description of the room, items in the room, characters in the room, and directions the player can move
-    */
-    string description; 
-    vector<Item> items;
-    vector<Character> characters;
-    map<string, Location*> directions;
+    const Record* end() const {
+        return last;
+    }
+
+    size_t size() const {
+        return last - first;
+    }
+
+    bool empty() const {
+        return first == last;
+    }
+
+    const Record& operator[](size_t index) const {
+        return first[index];
+    }
 };
 
 /*
-Control class conttols where the player is in the game and what they can do
+Triggers make things happen when the player does something: talks to a character, takes an item, enters a room,
+or spends a turn in a room. Each trigger is read from the world file and compiled into a short list of instructions
+that are carried out in order. The "Require" instructions stop the trigger when their condition does not hold,
+and an instruction's operand is the number of its text, the index of its room, or the symbol of its item's name
 */
-class Control {
-public:
-    Control() {
-        // Read instructions from the file
-        readInstructions();
-        
-        /*
-        Create the locations in the game
-        */
-        hole = Location("You have fallen into a rabbit hole with many paths. The place is dimly lit and musty.");
-        tulgey = Location("You have entered the Tulgey Wood. It is dark and mysterious. You hear strange noises.");
-        dutchess_house = Location("You have found the dutchess house. The dutchess has some valuable advice, but she is at a croquet game.");
-        pool = Location("You have found the pool of tears, the caterpillar is the only one here");
-        wonderland = Location("You have made it to wonderland. You see a large castle in the distance. You will need to come back with the correct item to enter the castle.");
-        safe_room = Location("This is the safe room. You can take an item or leave an item, but you can only carry one item at a time.");
-        croquet_ground = Location("This is the croquet ground. The Queen of Hearts is playing croquet. With the other characters");
-
-        /*
-        Locations are connected based on a (north, south, east, west) direction 
-        */
-        // in the hole there is a path north to the tulgey wood
-        hole.addDirection("north", &tulgey);
-
-        // in the tulgey wood there is a path west to the croquet ground, south to the hole, east to the dutchess' house
-        tulgey.addDirection("south", &hole);
-        tulgey.addDirection("east", &dutchess_house);
-        tulgey.addDirection("west", &croquet_ground);
-
-        // in the dutchess' house there is a path west to the tulgey wood, east to wonderland, south to the pool
-        dutchess_house.addDirection("west", &tulgey);
-        dutchess_house.addDirection("east", &wonderland);
-        dutchess_house.addDirection("south", &pool);
-
-        // in the pool there is a path north to the dutchess' house
-        pool.addDirection("north", &dutchess_house);
-
-        // in wonderland there is a path west to the dutchess' house
-        wonderland.addDirection("west", &dutchess_house);
-
-        // in the croquet ground there is a path east to the tulgey wood
-        croquet_ground.addDirection("east", &tulgey);
-
-        // in the dutchess' house there is a path north to the safe room
-        dutchess_house.addDirection("north", &safe_room);
-
-        // in the safe room there is a path south to the dutchess' house
-        safe_room.addDirection("south", &dutchess_house);
-
-        // These items are added to the safe room
-        safe_room.addItem("key");
-        safe_room.addItem("mushroom");
-        safe_room.addItem("cookies");
-        safe_room.addItem("bottle");
-        safe_room.addItem("sword");
-        safe_room.addItem("watch");
-        safe_room.addItem("upelkuchen");
-        safe_room.addItem("chronosphere");
-        safe_room.addItem("hat");
-        safe_room.addItem("gloves");
-        safe_room.addItem("letter");
-        safe_room.addItem("fan");
-
-        // This character is added to the pool
-        pool.addCharacter("caterpillar", "The Caterpillar: You will need to grab an item from the storage to get to where you need!");
-
-        // These characters are added to the croquet ground
-        croquet_ground.addCharacter("hatter", "You may have thought I was going to give you a hint, I'm just here to say: I love my hats! I have a hat for every occasion.");
-        croquet_ground.addCharacter("dutchess", "The Dutchess: I am the Dutchess of hearts. Beware of the Queen of hearts, she is not as nice as she seems.");
-        croquet_ground.addCharacter("queen", "I am the Queen of hearts; talk to me an you will be rewarded with a little surprise.");
-        croquet_ground.addCharacter("rabbit", "I am the White rabbit! If you find the right person, you will be rewarded with a map");
-
-        
-        currentLocation = &hole; // The game starts in the hole
+enum Event { TalkEvent, TakeEvent, EnterEvent, TurnEvent, EventCount };
+const string_view EVENT_NAMES[EventCount] = {"talk", "take", "enter", "turn"};
+
+// Whether the subject of the event is a room (enter and turn) rather than a name (talk and take)
+constexpr bool isRoomEvent(Event event) {
+    return event == EnterEvent || event == TurnEvent;
+}
+
+enum class Op : uint32_t { RequireHolding, RequireIn, Say, Dialogue, Map, Win, Lose };
+
+struct Instruction {
+    Op op;
+    uint32_t operand;
+};
+
+/*
+How a trigger is kept in a compiled world: its event, and where its instructions start (they end where the next
+trigger's start). A room's enter and turn triggers are kept together, and so are a name's talk and take triggers
+*/
+struct Trigger {
+    uint32_t event; // An Event
+    uint32_t firstInstruction;
+};
+
+/*
+The default world is used if world.txt cannot be opened, since the game needs a world to play in. It is written as
+tables that the compiler checks: every exit, item, character and the start must name a room in BUILTIN_ROOMS, or
+the game does not compile. The tables are compiled into BUILTIN_IMAGE with the game, so loading it does nothing at all
+*/
+struct BuiltinRoom {
+    string_view name;
+    string_view description;
+};
+
+constexpr BuiltinRoom BUILTIN_ROOMS[] = {
+    {"hole", "You have fallen into a rabbit hole with many paths. The place is dimly lit and musty."},
+    {"tulgey", "You have entered the Tulgey Wood. It is dark and mysterious. You hear strange noises."},
+    {"dutchess_house", "You have found the dutchess house. The dutchess has some valuable advice, but she is at a croquet game."},
+    {"pool", "You have found the pool of tears, the caterpillar is the only one here"},
+    {"wonderland", "You have made it to wonderland. You see a large castle in the distance. You will need to come back with the correct item to enter the castle."},
+    {"safe_room", "This is the safe room. You can take an item or leave an item, but you can only carry one item at a time."},
+    {"croquet_ground", "This is the croquet ground. The Queen of Hearts is playing croquet. With the other characters"},
+};
+
+// The index of a built-in room; a name that is not a room cannot be worked out at compile time, so the game does not compile
+constexpr size_t builtinRoom(string_view name) {
+    for (size_t room = 0; room < size(BUILTIN_ROOMS); room++) {
+        if (BUILTIN_ROOMS[room].name == name) {
+            return room;
+        }
     }
+    throw "The built-in world has no room with this name";
+}
 
-    void startGame() {
-        // Player inventory
-        vector<Item> inventory;
+struct BuiltinExit {
+    size_t from;
+    Direction direction;
+    size_t to;
+};
 
-        // Game loop
-        while (true) {
-            currentLocation->display(); // Display the current location
+constexpr BuiltinExit BUILTIN_EXITS[] = {
+    {builtinRoom("hole"), North, builtinRoom("tulgey")},
+    {builtinRoom("tulgey"), South, builtinRoom("hole")},
+    {builtinRoom("tulgey"), East, builtinRoom("dutchess_house")},
+    {builtinRoom("tulgey"), West, builtinRoom("croquet_ground")},
+    {builtinRoom("dutchess_house"), West, builtinRoom("tulgey")},
+    {builtinRoom("dutchess_house"), East, builtinRoom("wonderland")},
+    {builtinRoom("dutchess_house"), South, builtinRoom("pool")},
+    {builtinRoom("dutchess_house"), North, builtinRoom("safe_room")},
+    {builtinRoom("pool"), North, builtinRoom("dutchess_house")},
+    {builtinRoom("wonderland"), West, builtinRoom("dutchess_house")},
+    {builtinRoom("croquet_ground"), East, builtinRoom("tulgey")},
+    {builtinRoom("safe_room"), South, builtinRoom("dutchess_house")},
+};
 
-            // Check if player has won (The player needs the key in their inventory to enter wonderland)
-            if (currentLocation == &wonderland && hasItem("key", inventory)) {
-                cout << "You win!" << endl;
-                exit(0);
-            }
+struct BuiltinItem {
+    size_t room;
+    string_view name;
+};
 
-            // Player input
-            string action;
-            cout << "Enter a direction (north, east, south, or west), 'take <item>' to pick up an item, 'leave <item>' to leave an item, or 'talk <character>' to talk to a character: ";
-            getline(cin, action);
+constexpr BuiltinItem BUILTIN_ITEMS[] = {
+    {builtinRoom("safe_room"), "key"},
+    {builtinRoom("safe_room"), "mushroom"},
+    {builtinRoom("safe_room"), "cookies"},
+    {builtinRoom("safe_room"), "bottle"},
+    {builtinRoom("safe_room"), "sword"},
+    {builtinRoom("safe_room"), "watch"},
+    {builtinRoom("safe_room"), "upelkuchen"},
+    {builtinRoom("safe_room"), "chronosphere"},
+    {builtinRoom("safe_room"), "hat"},
+    {builtinRoom("safe_room"), "gloves"},
+    {builtinRoom("safe_room"), "letter"},
+    {builtinRoom("safe_room"), "fan"},
+};
 
-            if (action.substr(0, 5) == "take ") { // Take an item
-                if (!inventory.empty()) { // Check if the player is already carrying an item
-                    cout << "You can only carry one item at a time. Leave the current item before taking another.\n";
-                    continue;
-                }
+struct BuiltinCharacter {
+    size_t room;
+    string_view name;
+    string_view dialogue;
+};
 
-                string itemName = action.substr(5); // Get the item name
-                bool success = currentLocation->takeItem(itemName, inventory); // Take the item
-                if (!success) {
-                    cout << "Item not found in the room.\n"; // Item not found
-                }
-            } else if (action.substr(0, 6) == "leave ") { // Leave an item
-                string itemName = action.substr(6); // Get the item name
-                bool success = currentLocation->leaveItem(itemName, inventory); // Leave the item
-                if (!success) {
-                    cout << "Item not found in the inventory.\n";
-                }
-            } else if (action.substr(0, 5) == "talk ") { // Talk to a character
-                string characterName = action.substr(5); // Get the character name
-                talkToCharacter(characterName); // Talk to the character
-            } else {
-                // Directly process the direction input
-                Location* nextLocation = currentLocation->move(action, inventory); // Move to the next location
-                if (nextLocation) { // If the next location is not null
-                    currentLocation = nextLocation; // Move to the next location
-                }
-            }
+constexpr BuiltinCharacter BUILTIN_CHARACTERS[] = {
+    {builtinRoom("pool"), "caterpillar",
+        "The Caterpillar: You will need to grab an item from the storage to get to where you need!"},
+    {builtinRoom("croquet_ground"), "hatter",
+        "You may have thought I was going to give you a hint, I'm just here to say: I love my hats! I have a hat for every occasion."},
+    {builtinRoom("croquet_ground"), "dutchess",
+        "The Dutchess: I am the Dutchess of hearts. Beware of the Queen of hearts, she is not as nice as she seems."},
+    {builtinRoom("croquet_ground"), "queen",
+        "I am the Queen of hearts; talk to me an you will be rewarded with a little surprise."},
+    {builtinRoom("croquet_ground"), "rabbit",
+        "I am the White rabbit! If you find the right person, you will be rewarded with a map"},
+};
+
+constexpr size_t BUILTIN_START = builtinRoom("hole");
+
+/*
+A built-in trigger's instructions name their item, room or text directly; they are compiled like the triggers of world.txt.
+A trigger is made with builtinTrigger, which counts its instructions, so its length is never written by hand
+*/
+struct BuiltinInstruction {
+    Op op;
+    string_view text;
+};
+
+struct BuiltinTrigger {
+    Event event;
+    string_view subject;
+    size_t length;
+    BuiltinInstruction code[4];
+};
+
+template <size_t Length>
+constexpr BuiltinTrigger builtinTrigger(Event event, string_view subject, const BuiltinInstruction (&code)[Length]) {
+    static_assert(Length <= size(BuiltinTrigger{}.code), "A trigger of the built-in world has too many instructions");
+    BuiltinTrigger trigger{event, subject, Length, {}};
+    for (size_t i = 0; i < Length; i++) {
+        trigger.code[i] = code[i];
+    }
+    return trigger;
+}
+
+constexpr BuiltinTrigger BUILTIN_TRIGGERS[] = {
+    builtinTrigger(TalkEvent, "queen", {
+        {Op::Say, "Queen: You've stolen my memories, and now I'll take your life!"},
+        {Op::Say, "Game Over - The queen has killed you out of revenge for stealing her memories."},
+        {Op::Lose, ""}
+    }),
+    builtinTrigger(TalkEvent, "caterpillar", {
+        {Op::Dialogue, ""},
+        {Op::Map, ""}
+    }),
+    builtinTrigger(TurnEvent, "wonderland", {
+        {Op::RequireHolding, "key"},
+        {Op::Say, "You win!"},
+        {Op::Win, ""}
+    }),
+};
+
+// Whether a table of the built-in world (rooms, items or characters) has an entry with this name
+template <typename Table>
+constexpr bool builtinHas(const Table& table, string_view name) {
+    for (const auto& entry : table) {
+        if (entry.name == name) {
+            return true;
         }
     }
+    return false;
+}
+
 /*
-If the player talks to the queen of hearts, the game ends and they lose, but if they talk to the caterpillar, they are given a map
+Checks that every trigger is about something the built-in world has: talk triggers name a character, take triggers
+and "if holding" conditions an item, and enter and turn triggers and "if in" conditions a room
 */
-void talkToCharacter(const string& characterName) {
-    for (const auto& character : currentLocation->getCharacters()) {
-        if (character.getName() == characterName) { // If the character is found in the room
-            if (characterName == "queen") { // If the character is the queen of hearts
-                cout << "Queen: You've stolen my memories, and now I'll take your life!" << endl;
-                cout << "Game Over - The queen has killed you out of revenge for stealing her memories." << endl;
-                exit(0); // The game ends
-            } else if (characterName == "caterpillar") { // If the character is the caterpillar
-                cout << character.getDialogue() << endl; // The caterpillar gives the player a map and advice
-                openMapsFile(); // The map is opened
-                return;
-            } else {
-                cout << character.getDialogue() << endl; // The character gives the player advice
-                return;
+constexpr bool builtinTriggersValid() {
+    for (const auto& trigger : BUILTIN_TRIGGERS) {
+        if ((trigger.event == TalkEvent && !builtinHas(BUILTIN_CHARACTERS, trigger.subject))
+            || (trigger.event == TakeEvent && !builtinHas(BUILTIN_ITEMS, trigger.subject))
+            || ((trigger.event == EnterEvent || trigger.event == TurnEvent) && !builtinHas(BUILTIN_ROOMS, trigger.subject))) {
+            return false;
+        }
+        for (size_t i = 0; i < trigger.length; i++) {
+            const BuiltinInstruction& instruction = trigger.code[i];
+            if ((instruction.op == Op::RequireHolding && !builtinHas(BUILTIN_ITEMS, instruction.text))
+                || (instruction.op == Op::RequireIn && !builtinHas(BUILTIN_ROOMS, instruction.text))) {
+                return false;
             }
         }
     }
-    cout << "Character not found in the room.\n"; // If the player tries to talk to a character that is not in the room
+    return true;
 }
+static_assert(builtinTriggersValid(), "A trigger of the built-in world names a character, item or room the world does not have");
 
-void openMapsFile() { // Function to open the maps file
-    ifstream mapsFile("maps.txt"); // The maps file is opened
-    if (mapsFile.is_open()) { // If the file is open
-        string line; // The file is read line by line
-        while (getline(mapsFile, line)) { 
-            cout << line << endl;
+#ifndef NO_METRICS
+/*
+Metrics counts the operations of every session of the process and keeps a histogram of how long each took. Each thread
+counts into counters of its own, which only it writes, so recording an operation takes no lock and shares no cache
+line with another thread; the counters are atomic only so that the statistics can be summed while the threads go on.
+Every thread's counters are in one registry, which sums them when the statistics are written, and which keeps the
+counts of threads that have ended. Compiling with -DNO_METRICS removes all of it
+*/
+class Metrics {
+public:
+    enum Operation { Parse, Move, Take, Leave, Talk, Display, ReadFile, OperationCount };
+
+    // Adds one operation that took the given time; bucket b of the histogram holds times from 2^b up to 2^(b+1) ns
+    static void record(Operation operation, uint64_t nanoseconds) {
+        int bucket = 0;
+        while (bucket < BUCKETS - 1 && nanoseconds >> (bucket + 1) != 0) {
+            bucket++;
         }
-        mapsFile.close();
-    } else {
-        cout << "Unable to open maps.txt.\n"; // If the file is not open, an error message is displayed
+        Counters& counters = threadCounters();
+        add(counters.counts[operation], 1);
+        add(counters.totals[operation], nanoseconds);
+        add(counters.histograms[operation][bucket], 1);
     }
-}
 
-    // Function to read instructions from the file
-    void readInstructions() {
-        ifstream file("instructions.txt");
-        if (file.is_open()) { // If the file is open
-            string line; // The file is read line by line
-            while (getline(file, line)) {
-                instructions += line + "\n"; // The instructions are added to the string
+    /*
+    Writes every count, total and percentile of the whole process in a plain text format, one value per line, that
+    monitoring tools can scrape
+    */
+    static void write(ostream& out) {
+        static const char* const names[OperationCount] = {"parse", "move", "take", "leave", "talk", "display", "read_file"};
+        Sums sums;
+        {
+            Registry& registry = getRegistry();
+            lock_guard<mutex> guard(registry.lock); // Only keeps threads from ending or starting while they are summed
+            sums.add(registry.ended);
+            for (const Counters* counters : registry.threads) {
+                sums.add(*counters);
+            }
+        }
+        for (int operation = 0; operation < OperationCount; operation++) {
+            out << "alice_operations_total{operation=\"" << names[operation] << "\"} " << sums.counts[operation] << '\n';
+            out << "alice_operation_nanoseconds_total{operation=\"" << names[operation] << "\"} " << sums.totals[operation] << '\n';
+            for (double fraction : {0.5, 0.99}) {
+                out << "alice_operation_nanoseconds{operation=\"" << names[operation] << "\",quantile=\"" << fraction << "\"} "
+                    << sums.percentile(static_cast<Operation>(operation), fraction) << '\n';
             }
-            file.close();
-        } else {
-            /*
-            The default instructions are used if the file is not open, since the game needs instructions
-            */
-            cout << "Unable to open instructions.txt. Using default instructions.\n";
-            instructions = "Welcome to the Game!\n";
-            instructions += "Your goal is to find the key and reach the final room.\n";
-            instructions += "You can move between rooms using the directions north, east, south, or west.\n";
-            instructions += "Use 'take <item>' to pick up an item and 'leave <item>' to leave an item.\n";
-            instructions += "You can also 'talk <character>' to interact with characters in the room.\n";
         }
     }
 
-    // Function to get the instructions
-    const string& getInstructions() const {
-        return instructions; // The instructions are returned
+private:
+    static constexpr int BUCKETS = 40; // Up to 2^40 ns, about 18 minutes
+
+    // The counters of one thread, on cache lines of their own
+    struct alignas(64) Counters {
+        atomic<uint64_t> counts[OperationCount] = {};
+        atomic<uint64_t> totals[OperationCount] = {};
+        atomic<uint64_t> histograms[OperationCount][BUCKETS] = {};
+    };
+
+    // Only the thread that owns the counter writes it, so it is added to without a read-modify-write
+    static void add(atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(memory_order_relaxed) + amount, memory_order_relaxed);
     }
 
-private:
-    // Function to check if the player has an item
-    bool hasItem(const string& itemName, const vector<Item>& inventory) {
-        for (const auto& item : inventory) { // The player's inventory is checked
-            if (item.getName() == itemName) { // If the item is found
-                return true; 
+    // The counters of every thread added up, as they are written out
+    struct Sums {
+        uint64_t counts[OperationCount] = {};
+        uint64_t totals[OperationCount] = {};
+        uint64_t histograms[OperationCount][BUCKETS] = {};
+
+        void add(const Counters& counters) {
+            for (int operation = 0; operation < OperationCount; operation++) {
+                counts[operation] += counters.counts[operation].load(memory_order_relaxed);
+                totals[operation] += counters.totals[operation].load(memory_order_relaxed);
+                for (int bucket = 0; bucket < BUCKETS; bucket++) {
+                    histograms[operation][bucket] += counters.histograms[operation][bucket].load(memory_order_relaxed);
+                }
             }
         }
-        return false;
-    }
+
+        // The top of the histogram bucket that holds the given fraction of the operations
+        uint64_t percentile(Operation operation, double fraction) const {
+            uint64_t wanted = static_cast<uint64_t>(fraction * counts[operation]);
+            uint64_t seen = 0;
+            for (int bucket = 0; bucket < BUCKETS; bucket++) {
+                seen += histograms[operation][bucket];
+                if (seen > wanted) {
+                    return uint64_t(2) << bucket;
+                }
+            }
+            return 0;
+        }
+    };
+
+    // The counters of every running thread, and the sum of those of the threads that have ended
+    struct Registry {
+        mutex lock;
+        vector<const Counters*> threads;
+        Counters ended;
+    };
 
     /*
-    The following locations are created and a pointer to the current location is created
+    The registry is made on first use and never destroyed, since threads (those of the WorkerPool, say) can end after
+    the program's static objects are gone
     */
-    Location* currentLocation;
-    Location hole{"You have fallen into a rabbit hole with many paths. The place is dimly lit and musty."};
-    Location tulgey{"You have entered the Tulgey Wood. It is dark and mysterious. You hear strange noises."};
-    Location dutchess_house{"You have found the dutchess house. The dutchess has some valuable advice, but she is at a croquet game."};
-    Location pool{"You have found the pool of tears, the caterpillar is the only one here"};
-    Location wonderland{"You have made it to wonderland. You see a large castle in the distance. You will need to come back with the correct item to enter the castle."};
-    Location safe_room{"This is the safe room. You can take an item or leave an item, but you can only carry one item at a time."};
-    Location croquet_ground{"This is the croquet ground. The Queen of Hearts is playing croquet. With the other characters"};
-    string instructions;
+    static Registry& getRegistry() {
+        static Registry* registry = new Registry;
+        return *registry;
+    }
+
+    // A thread's counters, which are in the registry for as long as the thread runs
+    struct ThreadCounters {
+        ThreadCounters() {
+            Registry& registry = getRegistry();
+            lock_guard<mutex> guard(registry.lock);
+            registry.threads.push_back(&counters);
+        }
+
+        ~ThreadCounters() {
+            Registry& registry = getRegistry();
+            lock_guard<mutex> guard(registry.lock);
+            for (int operation = 0; operation < OperationCount; operation++) {
+                add(registry.ended.counts[operation], counters.counts[operation].load(memory_order_relaxed));
+                add(registry.ended.totals[operation], counters.totals[operation].load(memory_order_relaxed));
+                for (int bucket = 0; bucket < BUCKETS; bucket++) {
+                    add(registry.ended.histograms[operation][bucket], counters.histograms[operation][bucket].load(memory_order_relaxed));
+                }
+            }
+            registry.threads.erase(find(registry.threads.begin(), registry.threads.end(), &counters));
+        }
+
+        Counters counters;
+    };
+
+    static Counters& threadCounters() {
+        thread_local ThreadCounters mine;
+        return mine.counters;
+    }
 };
 
-/*
-Game Class is used to run the game
-*/
-class Game {
+// Times the rest of the block it is created in and records it when the block ends
+class ScopedTimer {
 public:
-    /*
-    Prints the instructions then starts the game
-    */
-    void run() {
-        Control game;
-        cout << game.getInstructions() << endl;
-        game.startGame();
+    explicit ScopedTimer(Metrics::Operation operation) : operation(operation), start(chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        Metrics::record(operation, chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
     }
+
+private:
+    Metrics::Operation operation;
+    chrono::steady_clock::time_point start;
 };
 
-int main() {
+#define MEASURE(operation) ScopedTimer scopedTimer(operation)
+#else
+#define MEASURE(operation)
+#endif
+
+// Writes the statistics of the whole process, which the stats command shows and the statistics file holds
+void writeStatistics(ostream& out) {
+#ifndef NO_METRICS
+    Metrics::write(out);
+#else
+    out << "Statistics are not available in this version of the game.\n";
+#endif
+}
+
+/*
+StatsWriter replaces the statistics file with the statistics of the whole process every STATS_INTERVAL, from a thread
+of its own, and once more when it is destroyed. The file is written to a temporary file and renamed into place, so
+readers never see half of it. If it cannot be written, that is reported once and it is not written again
+*/
+class StatsWriter {
+public:
+    explicit StatsWriter(const string& fileName) : fileName(fileName), writing([this] { writeEvery(); }) {}
+
+    ~StatsWriter() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_one();
+        writing.join();
+        write();
+    }
+
+private:
+    void writeEvery() {
+        unique_lock<mutex> guard(lock);
+        while (!wake.wait_for(guard, STATS_INTERVAL, [this] { return stopping; })) {
+            write();
+        }
+    }
+
+    void write() {
+        if (failed) {
+            return;
+        }
+        bool written;
+        {
+            ofstream stats(fileName + ".tmp", ios::trunc);
+            writeStatistics(stats);
+            written = static_cast<bool>(stats.flush());
+        }
+        error_code error;
+        if (written) {
+            filesystem::rename(fileName + ".tmp", fileName, error);
+        }
+        if (!written || error) {
+            cerr << "Unable to write " << fileName << ".\n";
+            failed = true;
+        }
+    }
+
+    static constexpr chrono::seconds STATS_INTERVAL{10};
+    string fileName;
+    mutex lock; // Guards stopping
+    condition_variable wake;
+    bool stopping = false;
+    bool failed = false; // Only used by the thread that writes, and after it has ended
+    thread writing;
+};
+
+/*
+AssetCache reads each text file the game shows (the map and the instructions) once for the whole process and shares
+the text with every session. A file is checked for changes at most once a second, and a changed file is read again
+without holding the lock, so sessions never wait for the disk. Sessions still showing the old text keep it until they
+are done with it
+*/
+class AssetCache {
+public:
+    // Returns the text of the file, or null if it cannot be read
+    static shared_ptr<const string> get(const string& fileName) {
+        AssetCache& cache = instance();
+        auto now = chrono::steady_clock::now();
+        {
+            lock_guard<mutex> guard(cache.lock);
+            auto it = cache.assets.find(fileName);
+            if (it != cache.assets.end() && now - it->second.checked < CHECK_INTERVAL) {
+                return it->second.text;
+            }
+        }
+
+        error_code error;
+        auto modified = filesystem::last_write_time(fileName, error);
+        if (!error) {
+            lock_guard<mutex> guard(cache.lock);
+            auto it = cache.assets.find(fileName);
+            if (it != cache.assets.end() && it->second.modified == modified) {
+                it->second.checked = now; // The file has not changed since it was read
+                return it->second.text;
+            }
+        }
+
+        ifstream file(fileName, ios::binary);
+        if (error || !file.is_open()) {
+            lock_guard<mutex> guard(cache.lock);
+            cache.assets.erase(fileName); // A file that is gone is not shown any more
+            return nullptr;
+        }
+        ostringstream contents;
+        contents << file.rdbuf();
+        auto text = make_shared<const string>(contents.str());
+
+        lock_guard<mutex> guard(cache.lock);
+        cache.assets[fileName] = Asset{text, modified, now};
+        return text;
+    }
+
+private:
+    /*
+    The text of a file, when the file was last changed, and when that was last checked
+    */
+    struct Asset {
+        shared_ptr<const string> text;
+        filesystem::file_time_type modified;
+        chrono::steady_clock::time_point checked;
+    };
+
+    static AssetCache& instance() {
+        static AssetCache cache; // Made the first time it is needed, which is safe across threads
+        return cache;
+    }
+
+    static constexpr chrono::seconds CHECK_INTERVAL{1};
+    mutex lock;
+    unordered_map<string, Asset> assets;
+};
+
+/*
+TextPool collects the texts of a world while it is compiled: the names in one pool, and the descriptions, dialogue and
+lines that triggers say in another. Each text is stored once however often it is used, and is known by its number,
+which is the order it was first added in
+*/
+class TextPool {
+public:
+    // Returns the number of the text, adding it if the pool does not have it yet
+    uint32_t add(string_view newText) {
+        auto it = numbers.find(newText);
+        if (it != numbers.end()) {
+            return it->second;
+        }
+        texts.emplace_back(newText);
+        numbers.emplace(texts.back(), static_cast<uint32_t>(texts.size() - 1));
+        return static_cast<uint32_t>(texts.size() - 1);
+    }
+
+    // Returns the number of the text, or NO_SYMBOL if the pool does not have it
+    uint32_t find(string_view text) const {
+        auto it = numbers.find(text);
+        return it != numbers.end() ? it->second : NO_SYMBOL;
+    }
+
+    string_view text(uint32_t number) const {
+        return texts[number];
+    }
+
+    uint32_t size() const {
+        return static_cast<uint32_t>(texts.size());
+    }
+
+private:
+    deque<string> texts; // A deque, so a text does not move when another is added, and numbers can point at it
+    unordered_map<string_view, uint32_t> numbers;
+};
+
+/*
+A compiled world is an image: a header followed by tables of fixed-size records and the characters of the names and
+texts. Records refer to each other by index, never by pointer, so an image is used just as it is stored; the game maps
+the file into memory and plays it without reading it into anything else. The tables, each starting on an 8 byte
+boundary, are:
+    Rooms         the Location of each room, and one more that marks where the last room's items, characters and triggers end
+    Items         the symbol of each item's name, grouped by room in the order they are displayed
+    Characters    the characters who stay where they are, grouped by room in the order they are displayed
+    Wanderers     the characters who wander, in the order of their wander lines
+    WandererItems the symbol of the item each wanderer carries when the game begins, or NO_SYMBOL
+    Symbols       where each name is in Names and where its talk and take triggers start, and one more to end the last
+    SymbolSlots   a hash table that finds the symbol of a name the player typed (each slot holds a symbol + 1, or 0)
+    Names         the characters of the names
+    Triggers      the triggers of each room, then those of each name, and one more to end the last
+    Instructions  the instructions of each trigger
+    Texts         where each text is: its block, and its place and length in the block
+    Blocks        where each block of texts is in TextData, and its size there and once it is decompressed
+    TextData      the blocks of texts, each compressed (see compressBlock) unless that would not make it smaller, in which
+                  case it is stored as it is, with the same size both ways
+Numbers are kept as the machine that compiled the image keeps them, and an image from a machine that keeps them the
+other way round is turned down
+*/
+enum class ImageTable { Rooms, Items, Characters, Wanderers, WandererItems, Symbols, SymbolSlots, Names, Triggers, Instructions, Texts, Blocks, TextData, Count };
+constexpr size_t IMAGE_TABLE_COUNT = static_cast<size_t>(ImageTable::Count);
+
+struct Symbol {
+    uint32_t offset; // In Names
+    uint32_t length;
+    uint32_t firstTrigger;
+};
+
+struct TextRecord {
+    uint32_t block;
+    uint32_t offset; // In the block
+    uint32_t length;
+};
+
+struct TextBlock {
+    uint64_t position; // In TextData
+    uint32_t storedSize;
+    uint32_t size;
+};
+
+struct ImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder; // IMAGE_BYTE_ORDER, as the compiling machine keeps it
+    uint32_t start; // The room every player starts in
+    uint32_t unused;
+    struct {
+        uint64_t offset; // From the start of the image
+        uint64_t count; // Of records
+    } tables[IMAGE_TABLE_COUNT];
+};
+
+constexpr char IMAGE_MAGIC[8] = {'A', 'L', 'I', 'C', 'E', 'I', 'M', 'G'};
+constexpr uint32_t IMAGE_VERSION = 6;
+constexpr uint32_t IMAGE_BYTE_ORDER = 0x01020304;
+constexpr size_t IMAGE_RECORD_SIZES[IMAGE_TABLE_COUNT] = {
+    sizeof(Location), sizeof(uint32_t), sizeof(Character), sizeof(Character), sizeof(uint32_t), sizeof(Symbol), sizeof(uint32_t), 1,
+    sizeof(Trigger), sizeof(Instruction), sizeof(TextRecord), sizeof(TextBlock), 1,
+};
+constexpr size_t TEXT_BLOCK_SIZE = 16 * 1024; // Texts are gathered into blocks of about this size
+constexpr size_t TEXT_CACHE_BLOCKS = 256; // The decompressed blocks a World keeps
+
+// The hash of a name in the SymbolSlots table (32 bit FNV-1a); images keep it, so it must never change
+constexpr uint32_t hashName(string_view name) {
+    uint32_t hash = 2166136261u;
+    for (char letter : name) {
+        hash = (hash ^ static_cast<unsigned char>(letter)) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+A block of texts is compressed as a run of sequences, each some letters to copy as they are and then a match: a number
+of letters to copy again from an offset back in what has been decompressed so far. A sequence starts with a byte whose
+high half is the number of letters and low half the length of the match less MIN_MATCH, where 15 means that bytes
+to add follow (each 255 means another follows); then come the letters, the offset in two bytes (low byte first) and the
+match's extra bytes. The last sequence has letters only, and ends the block
+*/
+constexpr size_t MIN_MATCH = 4;
+constexpr size_t MAX_MATCH_OFFSET = 65535;
+constexpr size_t MATCH_HASH_BITS = 12; // The compressor remembers where it last saw each of 4096 hashes of four letters
+
+// Writes a length that did not fit in its half of a sequence's first byte
+inline void writeExtraLength(string& packed, size_t length) {
+    for (; length >= 255; length -= 255) {
+        packed += static_cast<char>(255);
+    }
+    packed += static_cast<char>(length);
+}
+
+// Compresses a block of texts, finding each match through the hash of its first four letters
+inline string compressBlock(string_view block) {
+    string packed;
+    vector<uint32_t> lastSeen(size_t(1) << MATCH_HASH_BITS, UINT32_MAX);
+    auto hashAt = [&](size_t position) {
+        uint32_t word;
+        memcpy(&word, block.data() + position, sizeof(word));
+        return (word * 2654435761u) >> (32 - MATCH_HASH_BITS);
+    };
+    auto writeSequence = [&](size_t letters, size_t from, size_t matchLength, size_t offset) {
+        size_t extraMatch = matchLength - MIN_MATCH;
+        packed += static_cast<char>((min<size_t>(letters, 15) << 4) | (matchLength != 0 ? min<size_t>(extraMatch, 15) : 0));
+        if (letters >= 15) {
+            writeExtraLength(packed, letters - 15);
+        }
+        packed.append(block.data() + from, letters);
+        if (matchLength != 0) {
+            packed += static_cast<char>(offset & 0xFF);
+            packed += static_cast<char>(offset >> 8);
+            if (extraMatch >= 15) {
+                writeExtraLength(packed, extraMatch - 15);
+            }
+        }
+    };
+    size_t position = 0, lettersFrom = 0;
+    while (position + MIN_MATCH <= block.size()) {
+        uint32_t hash = hashAt(position);
+        size_t candidate = lastSeen[hash];
+        lastSeen[hash] = static_cast<uint32_t>(position);
+        if (candidate == UINT32_MAX || position - candidate > MAX_MATCH_OFFSET
+            || memcmp(block.data() + candidate, block.data() + position, MIN_MATCH) != 0) {
+            position++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (position + length < block.size() && block[candidate + length] == block[position + length]) {
+            length++;
+        }
+        writeSequence(position - lettersFrom, lettersFrom, length, position - candidate);
+        position += length;
+        lettersFrom = position;
+    }
+    writeSequence(block.size() - lettersFrom, lettersFrom, 0, 0);
+    return packed;
+}
+
+/*
+Decompresses a block into exactly size letters. Every length and offset is checked against the data and the block, so a
+damaged block can never be read or written outside of; returns false if it is damaged
+*/
+inline bool decompressBlock(const char* packed, size_t packedSize, char* block, size_t size) {
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(packed);
+    const unsigned char* inEnd = in + packedSize;
+    size_t out = 0;
+    auto readLength = [&](size_t length) {
+        if (length == 15) {
+            unsigned char more = 255;
+            while (more == 255 && in < inEnd) {
+                more = *in++;
+                length += more;
+            }
+        }
+        return length;
+    };
+    while (in < inEnd) {
+        unsigned char token = *in++;
+        size_t letters = readLength(token >> 4);
+        if (letters > size_t(inEnd - in) || letters > size - out) {
+            return false;
+        }
+        memcpy(block + out, in, letters);
+        in += letters;
+        out += letters;
+        if (in == inEnd) {
+            break; // The last sequence, which has no match
+        }
+        if (inEnd - in < 2) {
+            return false;
+        }
+        size_t offset = in[0] | (size_t(in[1]) << 8);
+        in += 2;
+        size_t length = readLength(token & 0x0F) + MIN_MATCH;
+        if (offset == 0 || offset > out || length > size - out) {
+            return false;
+        }
+        if (offset >= length) {
+            memcpy(block + out, block + out - offset, length);
+            out += length;
+        } else {
+            for (size_t i = 0; i < length; i++, out++) {
+                block[out] = block[out - offset]; // One letter at a time, since the match overlaps the letters it copies
+            }
+        }
+    }
+    return out == size;
+}
+
+/*
+The default world is compiled into its image when the game is compiled, so loading it reads, builds and allocates
+nothing: a World only points its tables at BUILTIN_IMAGE. Its names are its items' and characters' names and the items
+its triggers ask about, in the order they are first used; its texts are the room descriptions, the dialogue, and then
+the lines its triggers say, all kept in one block that is not compressed. The tables are laid out as WorldCompiler::build lays out those of a
+world file, and are exactly as long as the world needs, so their lengths are counted first
+*/
+struct BuiltinNames {
+    string_view names[size(BUILTIN_ITEMS) + size(BUILTIN_CHARACTERS) + size(BUILTIN_TRIGGERS) * (1 + size(BuiltinTrigger{}.code))] = {};
+    size_t count = 0;
+    size_t bytes = 0;
+
+    // The symbol of a name, or count if it is not one of the names
+    constexpr size_t find(string_view name) const {
+        for (size_t symbol = 0; symbol < count; symbol++) {
+            if (names[symbol] == name) {
+                return symbol;
+            }
+        }
+        return count;
+    }
+
+    constexpr void add(string_view name) {
+        if (find(name) == count) {
+            names[count++] = name;
+            bytes += name.size();
+        }
+    }
+};
+
+constexpr BuiltinNames builtinNames() {
+    BuiltinNames names;
+    for (const auto& item : BUILTIN_ITEMS) {
+        names.add(item.name);
+    }
+    for (const auto& character : BUILTIN_CHARACTERS) {
+        names.add(character.name);
+    }
+    for (const auto& trigger : BUILTIN_TRIGGERS) {
+        if (!isRoomEvent(trigger.event)) {
+            names.add(trigger.subject);
+        }
+        for (size_t i = 0; i < trigger.length; i++) {
+            if (trigger.code[i].op == Op::RequireHolding) {
+                names.add(trigger.code[i].text);
+            }
+        }
+    }
+    return names;
+}
+constexpr BuiltinNames BUILTIN_NAMES = builtinNames();
+
+// The number of instructions of the default world's triggers, or of those with the op if one is given
+constexpr size_t builtinInstructionCount(Op op, bool onlyOp) {
+    size_t count = 0;
+    for (const auto& trigger : BUILTIN_TRIGGERS) {
+        for (size_t i = 0; i < trigger.length; i++) {
+            count += !onlyOp || trigger.code[i].op == op;
+        }
+    }
+    return count;
+}
+
+constexpr size_t builtinTextBytes() {
+    size_t bytes = 0;
+    for (const auto& room : BUILTIN_ROOMS) {
+        bytes += room.description.size();
+    }
+    for (const auto& character : BUILTIN_CHARACTERS) {
+        bytes += character.dialogue.size();
+    }
+    for (const auto& trigger : BUILTIN_TRIGGERS) {
+        for (size_t i = 0; i < trigger.length; i++) {
+            bytes += trigger.code[i].op == Op::Say ? trigger.code[i].text.size() : 0;
+        }
+    }
+    return bytes;
+}
+
+constexpr size_t builtinSlotCount() {
+    size_t slotCount = 1;
+    while (slotCount < 2 * BUILTIN_NAMES.count) {
+        slotCount *= 2;
+    }
+    return slotCount;
+}
+
+constexpr size_t BUILTIN_INSTRUCTIONS = builtinInstructionCount(Op::Say, false);
+constexpr size_t BUILTIN_TEXTS = size(BUILTIN_ROOMS) + size(BUILTIN_CHARACTERS) + builtinInstructionCount(Op::Say, true);
+constexpr size_t BUILTIN_TEXT_BYTES = builtinTextBytes();
+constexpr size_t BUILTIN_SLOTS = builtinSlotCount();
+static_assert(BUILTIN_TEXT_BYTES <= TEXT_BLOCK_SIZE, "The texts of the built-in world do not fit in one block");
+
+struct BuiltinImage {
+    uint32_t start = 0;
+    Location rooms[size(BUILTIN_ROOMS) + 1] = {};
+    uint32_t items[size(BUILTIN_ITEMS)] = {};
+    Character characters[size(BUILTIN_CHARACTERS)] = {};
+    Symbol symbols[BUILTIN_NAMES.count + 1] = {};
+    uint32_t symbolSlots[BUILTIN_SLOTS] = {};
+    char names[BUILTIN_NAMES.bytes] = {};
+    Trigger triggers[size(BUILTIN_TRIGGERS) + 1] = {};
+    Instruction instructions[BUILTIN_INSTRUCTIONS] = {};
+    TextRecord texts[BUILTIN_TEXTS] = {};
+    TextBlock blocks[1] = {};
+    char textData[BUILTIN_TEXT_BYTES] = {};
+};
+
+constexpr BuiltinImage buildBuiltinImage() {
+    BuiltinImage image;
+    image.start = static_cast<uint32_t>(BUILTIN_START);
+
+    uint32_t textCount = 0, textBytes = 0;
+    auto addText = [&](string_view content) {
+        image.texts[textCount++] = {0, textBytes, static_cast<uint32_t>(content.size())};
+        for (char letter : content) {
+            image.textData[textBytes++] = letter;
+        }
+    };
+    for (const auto& room : BUILTIN_ROOMS) {
+        addText(room.description); // So the text of a room's description is the room's index
+    }
+    for (const auto& character : BUILTIN_CHARACTERS) {
+        addText(character.dialogue);
+    }
+    for (const auto& trigger : BUILTIN_TRIGGERS) {
+        for (size_t i = 0; i < trigger.length; i++) {
+            if (trigger.code[i].op == Op::Say) {
+                addText(trigger.code[i].text);
+            }
+        }
+    }
+    image.blocks[0] = {0, textBytes, textBytes};
+
+    uint32_t triggerCount = 0, instructionCount = 0;
+    auto addTrigger = [&](size_t index) {
+        const BuiltinTrigger& trigger = BUILTIN_TRIGGERS[index];
+        image.triggers[triggerCount++] = {static_cast<uint32_t>(trigger.event), instructionCount};
+        uint32_t say = static_cast<uint32_t>(size(BUILTIN_ROOMS) + size(BUILTIN_CHARACTERS)); // The text of the first line said
+        for (size_t before = 0; before < index; before++) {
+            for (size_t i = 0; i < BUILTIN_TRIGGERS[before].length; i++) {
+                say += BUILTIN_TRIGGERS[before].code[i].op == Op::Say;
+            }
+        }
+        for (size_t i = 0; i < trigger.length; i++) {
+            const BuiltinInstruction& instruction = trigger.code[i];
+            uint32_t operand = 0;
+            if (instruction.op == Op::RequireIn) {
+                operand = static_cast<uint32_t>(builtinRoom(instruction.text));
+            } else if (instruction.op == Op::RequireHolding) {
+                operand = static_cast<uint32_t>(BUILTIN_NAMES.find(instruction.text));
+            } else if (instruction.op == Op::Say) {
+                operand = say++;
+            }
+            image.instructions[instructionCount++] = {instruction.op, operand};
+        }
+    };
+
+    uint32_t itemCount = 0, characterCount = 0, dialogue = static_cast<uint32_t>(size(BUILTIN_ROOMS));
+    for (size_t room = 0; room <= size(BUILTIN_ROOMS); room++) {
+        Location& location = image.rooms[room];
+        location.firstItem = itemCount;
+        location.firstCharacter = characterCount;
+        location.firstTrigger = triggerCount;
+        for (uint32_t& exit : location.exits) {
+            exit = NO_ROOM;
+        }
+        if (room == size(BUILTIN_ROOMS)) {
+            break; // The last Location only ends the tables of the last room
+        }
+        location.description = static_cast<uint32_t>(room);
+        for (const auto& exit : BUILTIN_EXITS) {
+            if (exit.from == room) {
+                location.exits[exit.direction] = static_cast<uint32_t>(exit.to);
+            }
+        }
+        for (const auto& item : BUILTIN_ITEMS) {
+            if (item.room == room) {
+                image.items[itemCount++] = static_cast<uint32_t>(BUILTIN_NAMES.find(item.name));
+            }
+        }
+        for (size_t character = 0; character < size(BUILTIN_CHARACTERS); character++) {
+            if (BUILTIN_CHARACTERS[character].room == room) {
+                image.characters[characterCount++] = {static_cast<uint32_t>(BUILTIN_NAMES.find(BUILTIN_CHARACTERS[character].name)),
+                                                      dialogue + static_cast<uint32_t>(character), static_cast<uint32_t>(room)};
+            }
+        }
+        for (size_t trigger = 0; trigger < size(BUILTIN_TRIGGERS); trigger++) {
+            if (isRoomEvent(BUILTIN_TRIGGERS[trigger].event) && builtinRoom(BUILTIN_TRIGGERS[trigger].subject) == room) {
+                addTrigger(trigger);
+            }
+        }
+    }
+
+    uint32_t nameBytes = 0;
+    for (size_t symbol = 0; symbol <= BUILTIN_NAMES.count; symbol++) {
+        string_view name = symbol < BUILTIN_NAMES.count ? BUILTIN_NAMES.names[symbol] : string_view();
+        image.symbols[symbol] = {nameBytes, static_cast<uint32_t>(name.size()), triggerCount};
+        for (char letter : name) {
+            image.names[nameBytes++] = letter;
+        }
+        for (size_t trigger = 0; trigger < size(BUILTIN_TRIGGERS) && symbol < BUILTIN_NAMES.count; trigger++) {
+            if (!isRoomEvent(BUILTIN_TRIGGERS[trigger].event) && BUILTIN_TRIGGERS[trigger].subject == name) {
+                addTrigger(trigger);
+            }
+        }
+    }
+    image.triggers[triggerCount] = {0, instructionCount};
+
+    for (size_t symbol = 0; symbol < BUILTIN_NAMES.count; symbol++) {
+        size_t slot = hashName(BUILTIN_NAMES.names[symbol]) & (BUILTIN_SLOTS - 1);
+        while (image.symbolSlots[slot] != 0) {
+            slot = (slot + 1) & (BUILTIN_SLOTS - 1);
+        }
+        image.symbolSlots[slot] = static_cast<uint32_t>(symbol + 1);
+    }
+    return image;
+}
+constexpr BuiltinImage BUILTIN_IMAGE = buildBuiltinImage();
+
+/*
+WorldCompiler turns a world file (see world.txt for the format) into a world image.
+The file is read into memory once, and its rooms are created before anything else is read, so that a line can use a
+room declared further down the file. Everything with a name is from then on known by its room index or symbol, and the
+image is laid out with each room's items, characters and triggers together. --compile writes the image to a file;
+a world file that is played as it is is compiled in memory when it is loaded
+*/
+class WorldCompiler {
+public:
+    /*
+    Reads a world file; returns false, having read nothing, if it has no rooms. Problems with lines are written to messages
+    */
+    bool read(istream& file, const string& source, ostream& messages) {
+        string contents((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        vector<string_view> lines;
+        for (size_t begin = 0; begin < contents.size();) {
+            size_t end = min(contents.find('\n', begin), contents.size());
+            lines.push_back(string_view(contents).substr(begin, end - begin));
+            begin = end + 1;
+        }
+
+        for (string_view line : lines) {
+            istringstream words{string(line)};
+            string keyword, name, description;
+            if (words >> keyword && keyword == "room" && words >> name) {
+                getline(words >> ws, description);
+                addRoom(name, description);
+            }
+        }
+        if (rooms.empty()) {
+            return false; // The player needs a room to start in
+        }
+
+        static const string triggerKeywords[] = {"on", "if", "say", "dialogue", "map", "win", "lose"};
+        PendingTrigger* compiling = nullptr; // The trigger the instruction lines belong to
+        for (size_t lineNumber = 1; lineNumber <= lines.size(); lineNumber++) {
+            istringstream words{string(lines[lineNumber - 1])};
+            string keyword, roomName;
+            if (!(words >> keyword) || keyword[0] == '#' || keyword == "room") {
+                continue; // Blank lines, comments and rooms (already created) are skipped
+            }
+
+            if (find(begin(triggerKeywords), end(triggerKeywords), keyword) != end(triggerKeywords)) {
+                if (!compileTrigger(keyword, words, compiling)) {
+                    messages << "Invalid line " << lineNumber << " of " << source << ".\n";
+                }
+                continue;
+            }
+            compiling = nullptr; // Any other line ends the trigger before it
+
+            uint32_t room = (words >> roomName) ? findRoom(roomName) : NO_ROOM;
+            string first, rest;
+            words >> first;
+            getline(words >> ws, rest);
+
+            if (room == NO_ROOM) {
+                messages << "Unknown room on line " << lineNumber << " of " << source << ".\n";
+            } else if (keyword == "exit" && parseDirection(first) != DirectionCount && findRoom(rest) != NO_ROOM) {
+                rooms[room].exits[parseDirection(first)] = findRoom(rest);
+            } else if (keyword == "item" && !first.empty()) {
+                items.push_back({room, names.add(first)});
+            } else if (keyword == "character" && !first.empty()) {
+                characters.push_back({room, names.add(first), texts.add(rest), false});
+            } else if (keyword == "wander" && !first.empty() && rest.find_first_of(" \t") == string::npos) {
+                wanderLines.push_back({room, first, rest, lineNumber}); // The character can be on a line further down
+            } else if (keyword == "start") {
+                start = room;
+            } else {
+                messages << "Invalid line " << lineNumber << " of " << source << ".\n";
+            }
+        }
+
+        for (size_t character = 0; character < characters.size(); character++) {
+            characterIndex.emplace(uint64_t(characters[character].room) << 32 | characters[character].name, character); // Keeps the first
+        }
+        for (const auto& line : wanderLines) {
+            if (!startWandering(line.room, names.find(line.character), line.item.empty() ? NO_SYMBOL : names.add(line.item))) {
+                messages << "Invalid line " << line.lineNumber << " of " << source << ".\n";
+            }
+        }
+
+        if (start == NO_ROOM) {
+            start = 0; // Without a start line the game starts in the first room
+        }
+        return true;
+    }
+
+    /*
+    Lays out the image of the world that has been read, in 8 byte words so that every record in it is aligned
+    */
+    vector<uint64_t> build() const {
+        uint32_t roomCount = static_cast<uint32_t>(rooms.size());
+        uint32_t symbolCount = names.size();
+
+        // Each room's items, characters and triggers are put together, keeping the order the world gave them in
+        vector<PendingItem> roomItems(items);
+        vector<uint32_t> firstItems = group(roomItems, roomCount, [](const PendingItem& item) { return item.room; });
+        vector<PendingCharacter> staying;
+        copy_if(characters.begin(), characters.end(), back_inserter(staying), [](const PendingCharacter& character) { return !character.wanders; });
+        vector<uint32_t> firstCharacters = group(staying, roomCount, [](const PendingCharacter& character) { return character.room; });
+        vector<const PendingTrigger*> roomTriggers, nameTriggers;
+        for (const auto& trigger : triggers) {
+            (isRoomEvent(trigger.event) ? roomTriggers : nameTriggers).push_back(&trigger);
+        }
+        auto subjectOf = [](const PendingTrigger* trigger) { return trigger->subject; };
+        vector<uint32_t> firstRoomTriggers = group(roomTriggers, roomCount, subjectOf);
+        vector<uint32_t> firstNameTriggers = group(nameTriggers, symbolCount, subjectOf);
+
+        vector<Location> roomTable(roomCount + 1, Location{0, {NO_ROOM, NO_ROOM, NO_ROOM, NO_ROOM}, 0, 0, 0});
+        for (uint32_t room = 0; room <= roomCount; room++) {
+            if (room < roomCount) {
+                roomTable[room].description = rooms[room].description;
+                copy(begin(rooms[room].exits), end(rooms[room].exits), roomTable[room].exits);
+            }
+            roomTable[room].firstItem = firstItems[room];
+            roomTable[room].firstCharacter = firstCharacters[room];
+            roomTable[room].firstTrigger = firstRoomTriggers[room];
+        }
+        vector<uint32_t> itemTable;
+        for (const auto& item : roomItems) {
+            itemTable.push_back(item.name);
+        }
+        vector<Character> characterTable, wandererTable;
+        for (const auto& character : staying) {
+            characterTable.push_back({character.name, character.dialogue, character.room});
+        }
+        for (size_t wanderer : wanderers) {
+            wandererTable.push_back({characters[wanderer].name, characters[wanderer].dialogue, characters[wanderer].room});
+        }
+
+        vector<Trigger> triggerTable;
+        vector<Instruction> instructionTable;
+        for (const auto* list : {&roomTriggers, &nameTriggers}) {
+            for (const PendingTrigger* trigger : *list) {
+                triggerTable.push_back({static_cast<uint32_t>(trigger->event), static_cast<uint32_t>(instructionTable.size())});
+                instructionTable.insert(instructionTable.end(), trigger->code.begin(), trigger->code.end());
+            }
+        }
+        triggerTable.push_back({0, static_cast<uint32_t>(instructionTable.size())});
+
+        vector<Symbol> symbolTable;
+        string nameData;
+        for (uint32_t symbol = 0; symbol <= symbolCount; symbol++) {
+            string_view name = symbol < symbolCount ? names.text(symbol) : string_view();
+            symbolTable.push_back({static_cast<uint32_t>(nameData.size()), static_cast<uint32_t>(name.size()),
+                                   static_cast<uint32_t>(roomTriggers.size()) + firstNameTriggers[symbol]});
+            nameData += name;
+        }
+        size_t slotCount = 1;
+        while (slotCount < 2 * size_t(symbolCount)) {
+            slotCount *= 2; // At most half full, so a name is found in a slot or two
+        }
+        vector<uint32_t> slotTable(slotCount, 0);
+        for (uint32_t symbol = 0; symbol < symbolCount; symbol++) {
+            size_t slot = hashName(names.text(symbol)) & (slotCount - 1);
+            while (slotTable[slot] != 0) {
+                slot = (slot + 1) & (slotCount - 1);
+            }
+            slotTable[slot] = symbol + 1;
+        }
+
+        vector<TextRecord> textTable;
+        vector<TextBlock> blockTable;
+        string textData, block;
+        auto storeBlock = [&] {
+            string packed = compressBlock(block);
+            const string& stored = packed.size() < block.size() ? packed : block;
+            blockTable.push_back({textData.size(), static_cast<uint32_t>(stored.size()), static_cast<uint32_t>(block.size())});
+            textData += stored;
+            block.clear();
+        };
+        for (uint32_t text = 0; text < texts.size(); text++) {
+            string_view content = texts.text(text);
+            if (!block.empty() && block.size() + content.size() > TEXT_BLOCK_SIZE) {
+                storeBlock();
+            }
+            textTable.push_back({static_cast<uint32_t>(blockTable.size()), static_cast<uint32_t>(block.size()), static_cast<uint32_t>(content.size())});
+            block += content;
+        }
+        if (!textTable.empty()) {
+            storeBlock();
+        }
+
+        ImageHeader header = {};
+        copy(begin(IMAGE_MAGIC), end(IMAGE_MAGIC), header.magic);
+        header.version = IMAGE_VERSION;
+        header.byteOrder = IMAGE_BYTE_ORDER;
+        header.start = start;
+        vector<uint64_t> image((sizeof(ImageHeader) + 7) / 8);
+        auto addTable = [&](ImageTable table, const void* records, size_t count) {
+            size_t offset = image.size() * sizeof(uint64_t);
+            size_t bytes = count * IMAGE_RECORD_SIZES[static_cast<size_t>(table)];
+            image.resize(image.size() + (bytes + 7) / 8);
+            if (bytes != 0) {
+                memcpy(reinterpret_cast<char*>(image.data()) + offset, records, bytes);
+            }
+            header.tables[static_cast<size_t>(table)] = {offset, count};
+        };
+        addTable(ImageTable::Rooms, roomTable.data(), roomTable.size());
+        addTable(ImageTable::Items, itemTable.data(), itemTable.size());
+        addTable(ImageTable::Characters, characterTable.data(), characterTable.size());
+        addTable(ImageTable::Wanderers, wandererTable.data(), wandererTable.size());
+        addTable(ImageTable::WandererItems, wandererItems.data(), wandererItems.size());
+        addTable(ImageTable::Symbols, symbolTable.data(), symbolTable.size());
+        addTable(ImageTable::SymbolSlots, slotTable.data(), slotTable.size());
+        addTable(ImageTable::Names, nameData.data(), nameData.size());
+        addTable(ImageTable::Triggers, triggerTable.data(), triggerTable.size());
+        addTable(ImageTable::Instructions, instructionTable.data(), instructionTable.size());
+        addTable(ImageTable::Texts, textTable.data(), textTable.size());
+        addTable(ImageTable::Blocks, blockTable.data(), blockTable.size());
+        addTable(ImageTable::TextData, textData.data(), textData.size());
+        memcpy(image.data(), &header, sizeof(header));
+        return image;
+    }
+
+    // Writes the image to a file; returns false if it cannot be written
+    bool write(const string& fileName) const {
+        vector<uint64_t> image = build();
+        ofstream file(fileName, ios::binary | ios::trunc);
+        file.write(reinterpret_cast<const char*>(image.data()), image.size() * sizeof(uint64_t));
+        return static_cast<bool>(file.flush());
+    }
+
+private:
+    /*
+    What has been read of the world: rooms by index, and items and characters with the index of their room
+    */
+    struct PendingRoom {
+        uint32_t description;
+        uint32_t exits[DirectionCount];
+    };
+
+    struct PendingItem {
+        uint32_t room;
+        uint32_t name;
+    };
+
+    struct PendingCharacter {
+        uint32_t room;
+        uint32_t name;
+        uint32_t dialogue;
+        bool wanders;
+    };
+
+    // A wander line, which is only carried out once every character has been read
+    struct PendingWander {
+        uint32_t room;
+        string character;
+        string item; // Empty if the character carries nothing
+        size_t lineNumber;
+    };
+
+    struct PendingTrigger {
+        Event event;
+        uint32_t subject; // A room index for enter and turn triggers, a symbol for talk and take triggers
+        vector<Instruction> code;
+    };
+
+    void addRoom(string_view name, string_view description) {
+        roomIndex[string(name)] = static_cast<uint32_t>(rooms.size()); // A room declared twice is known by its last declaration
+        rooms.push_back({texts.add(description), {NO_ROOM, NO_ROOM, NO_ROOM, NO_ROOM}});
+    }
+
+    // Finds a room by the name it has in the world file; returns NO_ROOM if there is none
+    uint32_t findRoom(const string& name) const {
+        auto it = roomIndex.find(name);
+        return it != roomIndex.end() ? it->second : NO_ROOM;
+    }
+
+    /*
+    Makes the first character with the name in the room wander, carrying the item (or nothing, with NO_SYMBOL); returns
+    false if there is none. A character only wanders once
+    */
+    bool startWandering(uint32_t room, uint32_t name, uint32_t item) {
+        auto it = characterIndex.find(uint64_t(room) << 32 | name);
+        if (it == characterIndex.end() || !wanderingNames.insert(name).second) {
+            return false;
+        }
+        characters[it->second].wanders = true;
+        wanderers.push_back(it->second);
+        wandererItems.push_back(item);
+        return true;
+    }
+
+    /*
+    Compiles one line of a trigger from the world file: "on" starts a new trigger, and every other line adds an instruction
+    to the trigger being compiled. Returns false if the line is not valid
+    */
+    bool compileTrigger(const string& keyword, istream& words, PendingTrigger*& compiling) {
+        string rest;
+        if (keyword == "on") {
+            string eventName, subject;
+            words >> eventName >> subject;
+            int event = 0;
+            while (event < EventCount && EVENT_NAMES[event] != eventName) {
+                event++;
+            }
+            if (event == EventCount || subject.empty() || (isRoomEvent(static_cast<Event>(event)) && findRoom(subject) == NO_ROOM)) {
+                compiling = nullptr;
+                return false;
+            }
+            uint32_t subjectIndex = isRoomEvent(static_cast<Event>(event)) ? findRoom(subject) : names.add(subject);
+            triggers.push_back({static_cast<Event>(event), subjectIndex, {}});
+            compiling = &triggers.back();
+            return true;
+        }
+
+        getline(words >> ws, rest);
+        if (compiling == nullptr) {
+            return false; // An instruction must follow an "on" line
+        }
+        vector<Instruction>& code = compiling->code;
+        if (keyword == "if") {
+            istringstream condition(rest);
+            string kind, name;
+            condition >> kind >> name;
+            if (kind == "holding" && !name.empty()) {
+                code.push_back({Op::RequireHolding, names.add(name)});
+            } else if (kind == "in" && findRoom(name) != NO_ROOM) {
+                code.push_back({Op::RequireIn, findRoom(name)});
+            } else {
+                return false;
+            }
+        } else if (keyword == "say") {
+            code.push_back({Op::Say, texts.add(rest)});
+        } else if (keyword == "dialogue" && rest.empty()) {
+            code.push_back({Op::Dialogue, 0});
+        } else if (keyword == "map" && rest.empty()) {
+            code.push_back({Op::Map, 0});
+        } else if (keyword == "win" && rest.empty()) {
+            code.push_back({Op::Win, 0});
+        } else if (keyword == "lose" && rest.empty()) {
+            code.push_back({Op::Lose, 0});
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    /*
+    Sorts entries by their room or symbol, keeping the order of the entries of each, and returns where each one's entries
+    start; the entries of the last end where one more start would be
+    */
+    template <typename Entry, typename SubjectOf>
+    static vector<uint32_t> group(vector<Entry>& entries, uint32_t subjects, SubjectOf subjectOf) {
+        stable_sort(entries.begin(), entries.end(), [&](const Entry& a, const Entry& b) {
+            return subjectOf(a) < subjectOf(b);
+        });
+        vector<uint32_t> starts(size_t(subjects) + 1);
+        size_t next = 0;
+        for (uint32_t subject = 0; subject <= subjects; subject++) {
+            starts[subject] = static_cast<uint32_t>(next);
+            while (subject < subjects && next < entries.size() && subjectOf(entries[next]) == subject) {
+                next++;
+            }
+        }
+        return starts;
+    }
+
+    TextPool names; // Every name of an item or character, whose number is its symbol
+    TextPool texts;
+    vector<PendingRoom> rooms;
+    unordered_map<string, uint32_t> roomIndex; // Room names are only known while the world is compiled
+    vector<PendingItem> items;
+    vector<PendingCharacter> characters;
+    vector<PendingWander> wanderLines;
+    unordered_map<uint64_t, size_t> characterIndex; // The first character with each room and name, once every character is read
+    unordered_set<uint32_t> wanderingNames;
+    vector<size_t> wanderers; // The characters who wander, in the order of their wander lines
+    vector<uint32_t> wandererItems; // What each of them carries
+    deque<PendingTrigger> triggers; // A deque, so the trigger being compiled does not move when another is added
+    uint32_t start = NO_ROOM;
+};
+
+/*
+Text is a text of a world as it is shown: a view of its letters, and the decompressed block they are in, which is kept
+for as long as the Text is even if the world's cache lets go of it. A text of a block that is not compressed is viewed
+where it is in the image, and keeps nothing
+*/
+class Text {
+public:
+    Text(string_view letters, shared_ptr<const string> block = nullptr) : letters(letters), block(std::move(block)) {}
+
+    operator string_view() const {
+        return letters;
+    }
+
+    size_t size() const {
+        return letters.size();
+    }
+
+private:
+    string_view letters;
+    shared_ptr<const string> block;
+};
+
+inline ostream& operator<<(ostream& output, const Text& text) {
+    return output << static_cast<string_view>(text);
+}
+
+/*
+BlockCache keeps the blocks of texts that were shown most recently, decompressed, so the room a player is in or the
+character they talk to is not decompressed again each time. Every player of a world shares its cache, so it has a lock,
+which is only held to look a block up or add it; a block is decompressed without it. Once the cache is full, the block
+used longest ago is let go of
+*/
+class BlockCache {
+public:
+    explicit BlockCache(size_t capacity) : capacity(capacity) {}
+
+    // Returns the decompressed block, calling decompress for it if the cache does not have it
+    template <typename Decompress>
+    shared_ptr<const string> get(uint32_t block, Decompress decompress) {
+        {
+            lock_guard<mutex> guard(lock);
+            auto found = index.find(block);
+            if (found != index.end()) {
+                recent.splice(recent.begin(), recent, found->second); // Now the block used most recently
+                return found->second->second;
+            }
+        }
+        shared_ptr<const string> letters = decompress();
+        lock_guard<mutex> guard(lock);
+        auto found = index.find(block);
+        if (found != index.end()) {
+            return found->second->second; // Another player decompressed it meanwhile
+        }
+        recent.emplace_front(block, letters);
+        index.emplace(block, recent.begin());
+        if (recent.size() > capacity) {
+            index.erase(recent.back().first);
+            recent.pop_back();
+        }
+        return letters;
+    }
+
+private:
+    size_t capacity;
+    mutex lock;
+    list<pair<uint32_t, shared_ptr<const string>>> recent; // Used most recently first
+    unordered_map<uint32_t, list<pair<uint32_t, shared_ptr<const string>>>::iterator> index;
+};
+
+/*
+World class is a compiled world. It never changes once it is loaded, so any number of players on any number of threads
+read it without locks; what the players change is kept apart from it, in WorldChanges. A world image made by --compile
+is mapped from its file and used where it is, and a world file is compiled into the same image in memory as it is
+loaded. Either way the image is checked before it is used: every index in it must lead to a record of the image, so a
+damaged image is turned down rather than played
+*/
+class World {
+public:
+    /*
+    Loads the world image or world file, or the default world if the file cannot be opened or is not a world; problems
+    with the file are written to messages. With no world file, the default world is played
+    */
+    World(const string& worldFile, ostream& messages) {
+        if (worldFile.empty()) {
+            loadBuiltinWorld();
+            return;
+        }
+        ifstream file(worldFile, ios::binary);
+        char magic[sizeof(IMAGE_MAGIC)] = {};
+        if (!file.is_open()) {
+            messages << "Unable to open " << worldFile << ". Using default world.\n";
+            loadBuiltinWorld();
+        } else if (file.read(magic, sizeof(magic)) && equal(begin(magic), end(magic), begin(IMAGE_MAGIC))) {
+            file.close();
+            if (!mapImage(worldFile)) {
+                messages << worldFile << " is not a world image this game can play. Using default world.\n";
+                loadBuiltinWorld();
+            }
+        } else {
+            file.clear();
+            file.seekg(0);
+            WorldCompiler compiler;
+            if (compiler.read(file, worldFile, messages)) {
+                useImage(compiler.build());
+            } else {
+                messages << worldFile << " has no rooms. Using default world.\n";
+                loadBuiltinWorld();
+            }
+        }
+    }
+
+    ~World() {
+        if (mapping != nullptr) {
+            munmap(mapping, mappingSize);
+        }
+    }
+
+    World(const World&) = delete; // The tables point into the image the World holds
+    World& operator=(const World&) = delete;
+
+    // Functions to look at the world
+    uint32_t getRoomCount() const {
+        return static_cast<uint32_t>(rooms.size() - 1);
+    }
+
+    uint32_t getStart() const {
+        return start;
+    }
+
+    const Location& getLocation(uint32_t room) const {
+        return rooms[room];
+    }
+
+    // The room the direction leads to from the room, or NO_ROOM if there is no path that way (or it is not a direction)
+    uint32_t getExit(uint32_t room, Direction direction) const {
+        return direction < DirectionCount ? rooms[room].exits[direction] : NO_ROOM;
+    }
+
+    // The symbols of the names of the items the room has when the game begins
+    Span<uint32_t> getItems(uint32_t room) const {
+        return {items.first + rooms[room].firstItem, items.first + rooms[room + 1].firstItem};
+    }
+
+    // The characters in the room who never leave it
+    Span<Character> getCharacters(uint32_t room) const {
+        return {characters.first + rooms[room].firstCharacter, characters.first + rooms[room + 1].firstCharacter};
+    }
+
+    // The characters who wander, with the rooms they start in
+    Span<Character> getWanderers() const {
+        return wanderers;
+    }
+
+    // The symbol of the item each wanderer carries when the game begins, or NO_SYMBOL
+    Span<uint32_t> getWandererItems() const {
+        return wandererItems;
+    }
+
+    // The number of a wanderer, or NO_WANDERER if the character is not one
+    size_t wandererOf(const Character& character) const {
+        return &character >= wanderers.begin() && &character < wanderers.end() ? &character - wanderers.begin() : NO_WANDERER;
+    }
+
+    // A text of the world, decompressing its block (or finding it in the cache) if the block is compressed
+    Text getText(uint32_t text) const {
+        const TextRecord& record = texts[text];
+        const TextBlock& block = blocks[record.block];
+        if (block.storedSize == block.size) {
+            return string_view(textData.first + block.position + record.offset, record.length);
+        }
+        shared_ptr<const string> letters = blockCache.get(record.block, [&] {
+            auto decompressed = make_shared<string>(block.size, '?');
+            if (!decompressBlock(textData.first + block.position, block.storedSize, decompressed->data(), block.size)) {
+                decompressed->assign(block.size, '?'); // A damaged block is shown as question marks
+            }
+            return decompressed;
+        });
+        return Text(string_view(*letters).substr(record.offset, record.length), letters);
+    }
+
+    /*
+    The bytes of the world's texts: as many as every room, character and trigger that uses one shows between them, then
+    with each text only once, and then as they are stored in the image once their blocks are compressed
+    */
+    struct TextBytes {
+        size_t used = 0;
+        size_t unique = 0;
+        size_t stored = 0;
+    };
+
+    TextBytes measureTexts() const {
+        TextBytes bytes;
+        for (uint32_t room = 0; room < getRoomCount(); room++) {
+            bytes.used += texts[rooms[room].description].length;
+        }
+        for (const auto* group : {&characters, &wanderers}) {
+            for (const Character& character : *group) {
+                bytes.used += texts[character.dialogue].length;
+            }
+        }
+        for (const Instruction& instruction : instructions) {
+            if (instruction.op == Op::Say) {
+                bytes.used += texts[instruction.operand].length;
+            }
+        }
+        for (const TextBlock& block : blocks) {
+            bytes.unique += block.size;
+            bytes.stored += block.storedSize;
+        }
+        return bytes;
+    }
+
+    string_view getName(uint32_t symbol) const {
+        return string_view(names.first + symbols[symbol].offset, symbols[symbol].length);
+    }
+
+    uint32_t getSymbolCount() const {
+        return static_cast<uint32_t>(symbols.size() - 1);
+    }
+
+    // Returns the symbol of a name, or NO_SYMBOL if nothing in the world has the name
+    uint32_t findSymbol(string_view name) const {
+        size_t mask = symbolSlots.size() - 1;
+        size_t slot = hashName(name) & mask;
+        for (size_t probes = 0; probes < symbolSlots.size() && symbolSlots[slot] != 0; probes++) {
+            if (getName(symbolSlots[slot] - 1) == name) {
+                return symbolSlots[slot] - 1;
+            }
+            slot = (slot + 1) & mask;
+        }
+        return NO_SYMBOL;
+    }
+
+    /*
+    The triggers on the subject of an event (a room index for enter and turn, a symbol for talk and take), found by index
+    without hashing anything. A subject's triggers of both events of its kind are kept together, so the caller only
+    runs those whose event is the one that happened
+    */
+    Span<Trigger> getTriggers(Event event, uint32_t subject) const {
+        if (isRoomEvent(event)) {
+            return subject < getRoomCount() ? Span<Trigger>{triggers.first + rooms[subject].firstTrigger, triggers.first + rooms[subject + 1].firstTrigger} : Span<Trigger>();
+        }
+        return subject < getSymbolCount() ? Span<Trigger>{triggers.first + symbols[subject].firstTrigger, triggers.first + symbols[subject + 1].firstTrigger} : Span<Trigger>();
+    }
+
+    // The instructions of a trigger of this world, which end where those of the trigger after it start
+    Span<Instruction> getCode(const Trigger& trigger) const {
+        return {instructions.first + trigger.firstInstruction, instructions.first + (&trigger)[1].firstInstruction};
+    }
+
+    // The size of the world's image in bytes
+    size_t getImageSize() const {
+        return imageSize;
+    }
+
+private:
+    // Plays the default world, whose image was compiled with the game; its tables are used where they are
+    void loadBuiltinWorld() {
+        start = BUILTIN_IMAGE.start;
+        imageSize = sizeof(BUILTIN_IMAGE);
+        rooms = builtin(BUILTIN_IMAGE.rooms);
+        items = builtin(BUILTIN_IMAGE.items);
+        characters = builtin(BUILTIN_IMAGE.characters);
+        wanderers = {}; // Nobody wanders in the default world
+        wandererItems = {};
+        symbols = builtin(BUILTIN_IMAGE.symbols);
+        symbolSlots = builtin(BUILTIN_IMAGE.symbolSlots);
+        names = builtin(BUILTIN_IMAGE.names);
+        triggers = builtin(BUILTIN_IMAGE.triggers);
+        instructions = builtin(BUILTIN_IMAGE.instructions);
+        texts = builtin(BUILTIN_IMAGE.texts);
+        blocks = builtin(BUILTIN_IMAGE.blocks);
+        textData = builtin(BUILTIN_IMAGE.textData);
+    }
+
+    template <typename Record, size_t Count>
+    static Span<Record> builtin(const Record (&table)[Count]) {
+        return {table, table + Count};
+    }
+
+    // Plays an image compiled in memory, which the World keeps
+    void useImage(vector<uint64_t> image) {
+        compiled = std::move(image);
+        if (!attach(reinterpret_cast<const char*>(compiled.data()), compiled.size() * sizeof(uint64_t))) {
+            throw logic_error("The world compiler made an image that cannot be played");
+        }
+    }
+
+    // Maps a world image from its file; returns false if it cannot be mapped or is not a world image
+    bool mapImage(const string& fileName) {
+        int descriptor = open(fileName.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return false;
+        }
+        struct stat status;
+        bool mapped = false;
+        if (fstat(descriptor, &status) == 0 && static_cast<size_t>(status.st_size) >= sizeof(ImageHeader)) {
+            void* memory = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (memory != MAP_FAILED) {
+                mapping = memory;
+                mappingSize = status.st_size;
+                mapped = true;
+            }
+        }
+        close(descriptor); // The mapping keeps the file's contents
+        if (mapped && !attach(static_cast<const char*>(mapping), mappingSize)) {
+            munmap(mapping, mappingSize);
+            mapping = nullptr;
+            mapped = false;
+        }
+        return mapped;
+    }
+
+    /*
+    Finds the tables of an image and checks it; returns false if it is not an image of a world this game can play
+    */
+    bool attach(const char* image, size_t size) {
+        if (size < sizeof(ImageHeader)) {
+            return false;
+        }
+        const ImageHeader* header = reinterpret_cast<const ImageHeader*>(image);
+        if (!equal(begin(header->magic), end(header->magic), begin(IMAGE_MAGIC)) || header->version != IMAGE_VERSION
+            || header->byteOrder != IMAGE_BYTE_ORDER) {
+            return false;
+        }
+        for (size_t table = 0; table < IMAGE_TABLE_COUNT; table++) {
+            uint64_t offset = header->tables[table].offset;
+            uint64_t count = header->tables[table].count;
+            if (offset % 8 != 0 || offset < sizeof(ImageHeader) || offset > size || count > (size - offset) / IMAGE_RECORD_SIZES[table]
+                || count >= UINT32_MAX) {
+                return false;
+            }
+        }
+        imageSize = size;
+        start = header->start;
+        rooms = table<Location>(image, ImageTable::Rooms);
+        items = table<uint32_t>(image, ImageTable::Items);
+        characters = table<Character>(image, ImageTable::Characters);
+        wanderers = table<Character>(image, ImageTable::Wanderers);
+        wandererItems = table<uint32_t>(image, ImageTable::WandererItems);
+        symbols = table<Symbol>(image, ImageTable::Symbols);
+        symbolSlots = table<uint32_t>(image, ImageTable::SymbolSlots);
+        names = table<char>(image, ImageTable::Names);
+        triggers = table<Trigger>(image, ImageTable::Triggers);
+        instructions = table<Instruction>(image, ImageTable::Instructions);
+        texts = table<TextRecord>(image, ImageTable::Texts);
+        blocks = table<TextBlock>(image, ImageTable::Blocks);
+        textData = table<char>(image, ImageTable::TextData);
+        return checkRecords();
+    }
+
+    template <typename Record>
+    static Span<Record> table(const char* image, ImageTable which) {
+        const auto& table = reinterpret_cast<const ImageHeader*>(image)->tables[static_cast<size_t>(which)];
+        const Record* first = reinterpret_cast<const Record*>(image + table.offset);
+        return {first, first + table.count};
+    }
+
+    /*
+    Checks that every index in the image leads to a record of the image, and that every run of records (a room's items,
+    a trigger's instructions) starts where the one before it ends, so that playing it can never read outside it
+    */
+    bool checkRecords() const {
+        if (rooms.size() < 2 || symbols.empty() || triggers.empty() || symbolSlots.empty()
+            || (symbolSlots.size() & (symbolSlots.size() - 1)) != 0 || start >= getRoomCount()) {
+            return false;
+        }
+        uint32_t roomCount = getRoomCount(), symbolCount = getSymbolCount(), triggerCount = static_cast<uint32_t>(triggers.size() - 1);
+        for (uint32_t room = 0; room < roomCount; room++) {
+            const Location& location = rooms[room];
+            const Location& next = rooms[room + 1];
+            if (location.description >= texts.size() || location.firstItem > next.firstItem
+                || location.firstCharacter > next.firstCharacter || location.firstTrigger > next.firstTrigger) {
+                return false;
+            }
+            for (uint32_t exit : location.exits) {
+                if (exit != NO_ROOM && exit >= roomCount) {
+                    return false;
+                }
+            }
+        }
+        if (rooms[0].firstItem != 0 || rooms[0].firstCharacter != 0 || rooms[0].firstTrigger != 0 || rooms[roomCount].firstItem != items.size()
+            || rooms[roomCount].firstCharacter != characters.size() || rooms[roomCount].firstTrigger != symbols[0].firstTrigger) {
+            return false;
+        }
+        for (uint32_t symbol = 0; symbol < symbolCount; symbol++) {
+            if (symbols[symbol].firstTrigger > symbols[symbol + 1].firstTrigger || uint64_t(symbols[symbol].offset) + symbols[symbol].length > names.size()) {
+                return false;
+            }
+        }
+        if (symbols[symbolCount].firstTrigger != triggerCount) {
+            return false;
+        }
+        for (uint32_t item : items) {
+            if (item >= symbolCount) {
+                return false;
+            }
+        }
+        if (wandererItems.size() != wanderers.size()) {
+            return false;
+        }
+        for (uint32_t item : wandererItems) {
+            if (item != NO_SYMBOL && item >= symbolCount) {
+                return false;
+            }
+        }
+        for (const auto* group : {&characters, &wanderers}) {
+            for (const Character& character : *group) {
+                if (character.name >= symbolCount || character.dialogue >= texts.size() || character.room >= roomCount) {
+                    return false;
+                }
+            }
+        }
+        for (uint32_t slot : symbolSlots) {
+            if (slot > symbolCount) {
+                return false;
+            }
+        }
+        for (uint32_t trigger = 0; trigger < triggerCount; trigger++) {
+            bool roomTrigger = trigger < symbols[0].firstTrigger;
+            if (triggers[trigger].event >= EventCount || isRoomEvent(static_cast<Event>(triggers[trigger].event)) != roomTrigger
+                || triggers[trigger].firstInstruction > triggers[trigger + 1].firstInstruction) {
+                return false;
+            }
+        }
+        if (triggers[0].firstInstruction != 0 || triggers[triggerCount].firstInstruction != instructions.size()) {
+            return false;
+        }
+        for (const Instruction& instruction : instructions) {
+            bool valid;
+            switch (instruction.op) {
+            case Op::RequireHolding:
+                valid = instruction.operand < symbolCount;
+                break;
+            case Op::RequireIn:
+                valid = instruction.operand < roomCount;
+                break;
+            case Op::Say:
+                valid = instruction.operand < texts.size();
+                break;
+            case Op::Dialogue:
+            case Op::Map:
+            case Op::Win:
+            case Op::Lose:
+                valid = true;
+                break;
+            default:
+                valid = false; // Not an instruction of this version of the game
+            }
+            if (!valid) {
+                return false;
+            }
+        }
+        for (const TextRecord& text : texts) {
+            if (text.block >= blocks.size() || uint64_t(text.offset) + text.length > blocks[text.block].size) {
+                return false;
+            }
+        }
+        for (const TextBlock& block : blocks) {
+            if (block.storedSize > block.size || block.position > textData.size() || block.storedSize > textData.size() - block.position) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+    The image the world is played from: mapped from its file, compiled in memory, or the default world's BUILTIN_IMAGE
+    */
+    vector<uint64_t> compiled;
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    size_t imageSize = 0;
+    uint32_t start = 0; // The room every player starts in
+
+    /*
+    The tables of the image (see ImageTable)
+    */
+    Span<Location> rooms;
+    Span<uint32_t> items;
+    Span<Character> characters;
+    Span<Character> wanderers;
+    Span<uint32_t> wandererItems;
+    Span<Symbol> symbols;
+    Span<uint32_t> symbolSlots;
+    Span<char> names;
+    Span<Trigger> triggers;
+    Span<Instruction> instructions;
+    Span<TextRecord> texts;
+    Span<TextBlock> blocks;
+    Span<char> textData;
+    mutable BlockCache blockCache{TEXT_CACHE_BLOCKS}; // The compressed blocks that were read most recently, decompressed
+};
+
+/*
+RoomItems holds the items of a room that players have taken from or left in; the rooms nobody has changed are read
+from the world image. A taken item leaves an empty slot, so that the items after it do not have to move until the room
+is next closed up
+*/
+class RoomItems {
+public:
+    // Starts from the items the room has when the game begins
+    explicit RoomItems(Span<uint32_t> startItems) {
+        items.reserve(startItems.size());
+        for (uint32_t itemName : startItems) {
+            addItem(itemName);
+        }
+    }
+
+    // itemName is the symbol of the name of the item to add to the room
+    void addItem(uint32_t itemName) {
+        placeItem(Item(itemName));
+    }
+
+    // Removes every item from the room; used when a saved game puts back what the room held
+    void clearItems() {
+        items.clear();
+        emptySlots = 0;
+        itemIndex.reset();
+    }
+
+    /*
+    Used to take an item from the room and add it to the player's inventory. The first item with the name is taken
+    */
+    bool takeItem(uint32_t itemName, Inventory& inventory) {
+        uint32_t slot = NO_SLOT;
+        if (itemName == NO_SYMBOL) {
+            return false; // no item has a name that nothing in the world has
+        }
+        if (itemIndex) { // a room with many items finds the item in its index
+            auto it = itemIndex->chains.find(itemName);
+            if (it != itemIndex->chains.end() && it->second.first != NO_SLOT) {
+                slot = it->second.first;
+                it->second.first = itemIndex->next[slot]; // the next item with the same name is now the first
+                if (it->second.first == NO_SLOT) {
+                    it->second.last = NO_SLOT;
+                }
+            }
+        } else { // a room with a few items is quicker to look through
+            for (uint32_t i = 0; i < items.size(); i++) {
+                if (items[i].getName() == itemName) {
+                    slot = i;
+                    break;
+                }
+            }
+        }
+
+        if (slot == NO_SLOT) {
+            return false; // if the item is not in the room, return false
+        }
+        inventory.push_back(std::move(items[slot])); // move the item into the player's inventory
+        items[slot] = Item(NO_SYMBOL);
+        if (++emptySlots > items.size() / 2) { // a room with many items is closed up once it is half empty, so it does not keep growing
+            compactItems();
+        }
+        return true;
+    }
+
+    /*
+    Used to leave an item in the room and remove it from the player's inventory
+    */
+    bool leaveItem(uint32_t itemName, Inventory& inventory) {
+        auto it = find_if(inventory.begin(), inventory.end(), [&](const Item& item) { // find the item in the player's inventory
+            return item.getName() == itemName; // if the item is found, return the item
+        });
+
+        if (it != inventory.end()) { // if the item is in the player's inventory
+            if (!itemIndex) {
+                compactItems(); // a room with a few items is closed up before it grows, so taking and leaving do not make it grow
+            }
+            placeItem(std::move(*it)); // move the item into the room
+            inventory.erase(it); // remove the item from the player's inventory
+            return true;
+        }
+
+        return false;
+    }
+
+    // The number of items in the room
+    size_t itemCount() const {
+        return items.size() - emptySlots;
+    }
+
+    // Calls visit with the symbol of each item in the room, in the order they are displayed; the room is not changed
+    template <typename Visit>
+    void forEachItem(Visit visit) const {
+        for (const auto& item : items) {
+            if (item.getName() != NO_SYMBOL) { // the slot of a taken item is left empty
+                visit(item.getName());
+            }
+        }
+    }
+
+private:
+    // Adds an item after the others, and to the index if the room has one (or now has enough items to need one)
+    void placeItem(Item&& item) {
+        items.push_back(std::move(item));
+        if (itemIndex) {
+            itemIndex->next.push_back(NO_SLOT);
+            linkItem(static_cast<uint32_t>(items.size() - 1));
+        } else if (items.size() - emptySlots > INDEXED_ITEMS) {
+            indexItems();
+        }
+    }
+
+    // Closes up the empty slots of taken items, keeping the other items in order
+    void compactItems() {
+        if (emptySlots == 0) {
+            return;
+        }
+        items.erase(remove_if(items.begin(), items.end(), [](const Item& item) {
+            return item.getName() == NO_SYMBOL;
+        }), items.end());
+        emptySlots = 0;
+        if (itemIndex) {
+            indexItems(); // the items have moved to new slots
+        }
+    }
+
+    // Builds the index of the room's items again from the slots, reusing the memory it already has
+    void indexItems() {
+        if (!itemIndex) {
+            itemIndex = make_unique<ItemIndex>();
+        }
+        for (auto& chain : itemIndex->chains) {
+            chain.second = {NO_SLOT, NO_SLOT};
+        }
+        itemIndex->next.assign(items.size(), NO_SLOT);
+        for (uint32_t slot = 0; slot < items.size(); slot++) {
+            if (items[slot].getName() != NO_SYMBOL) {
+                linkItem(slot);
+            }
+        }
+    }
+
+    // Adds the slot to the end of the chain of slots holding its item's name; slots are linked in the order they are displayed
+    void linkItem(uint32_t slot) {
+        auto it = itemIndex->chains.emplace(items[slot].getName(), ItemChain{NO_SLOT, NO_SLOT}).first;
+        if (it->second.last == NO_SLOT) {
+            it->second.first = slot;
+        } else {
+            itemIndex->next[it->second.last] = slot;
+        }
+        it->second.last = slot;
+    }
+
+    /*
+    A room with more than INDEXED_ITEMS items keeps, for each item name, the first and last slots holding it, and
+    for each slot the next slot with the same name, so taking and leaving do not look through the room
+    */
+    static constexpr size_t INDEXED_ITEMS = 16;
+    static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+    struct ItemChain {
+        uint32_t first;
+        uint32_t last;
+    };
+
+    struct ItemIndex {
+        unordered_map<uint32_t, ItemChain> chains; // Found by the symbol of the item's name
+        vector<uint32_t> next;
+    };
+
+    vector<Item> items;
+    uint32_t emptySlots = 0; // Slots of items that have been taken
+    unique_ptr<ItemIndex> itemIndex; // Only rooms with many items have one
+};
+
+/*
+WorkerPool runs the batches of a large piece of work on every core at once: the pool's threads and the thread that
+asks both take batches until there are none left. There is one pool for the whole game, started the first time it is
+used, with a thread for each core but the one the caller is on. It does one piece of work at a time; a caller that
+finds it busy, or work with a single batch, does the work itself, so a caller never waits for someone else's work
+*/
+class WorkerPool {
+public:
+    static WorkerPool& shared() {
+        static WorkerPool pool(max(thread::hardware_concurrency(), 1u) - 1);
+        return pool;
+    }
+
+    ~WorkerPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // The threads that work on a piece of work: the pool's and the caller's
+    size_t getThreadCount() const {
+        return workers.size() + 1;
+    }
+
+    /*
+    Calls work(first, last) for each batch of batchSize of the numbers from 0 to count - 1, and returns once every batch
+    has been done. The batches are done in any order, on any thread, so they must not depend on each other
+    */
+    template <typename Work>
+    void parallelFor(size_t count, size_t batchSize, Work& work) {
+        Job job{&work, [](void* context, size_t first, size_t last) { (*static_cast<Work*>(context))(first, last); }, count, batchSize,
+                (count + batchSize - 1) / batchSize};
+        unique_lock<mutex> running(runLock, try_to_lock);
+        if (workers.empty() || job.batches < 2 || !running.owns_lock()) {
+            for (size_t first = 0; first < count; first += batchSize) {
+                work(first, min(count, first + batchSize));
+            }
+            return;
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            current = &job;
+            generation++;
+        }
+        wake.notify_all();
+        runBatches(job);
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&] { return job.finished == job.batches && job.helpers == 0; }); // The job is on this stack
+        current = nullptr;
+    }
+
+private:
+    struct Job {
+        void* context;
+        void (*call)(void* context, size_t first, size_t last);
+        size_t count;
+        size_t batchSize;
+        size_t batches;
+        atomic<size_t> next{0}; // The next batch to be taken
+        size_t finished = 0; // Batches done, counted under the pool's lock
+        size_t helpers = 0; // The pool's threads working on the job
+    };
+
+    explicit WorkerPool(size_t threadCount) {
+        for (size_t i = 0; i < threadCount; i++) {
+            workers.emplace_back([this] { help(); });
+        }
+    }
+
+    void runBatches(Job& job) {
+        size_t finished = 0;
+        for (size_t batch; (batch = job.next.fetch_add(1, memory_order_relaxed)) < job.batches; finished++) {
+            size_t first = batch * job.batchSize;
+            job.call(job.context, first, min(job.count, first + job.batchSize));
+        }
+        lock_guard<mutex> guard(lock);
+        job.finished += finished;
+    }
+
+    // What each of the pool's threads does: waits for a job, and takes batches of it until there are none left
+    void help() {
+        uint64_t seen = 0;
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            wake.wait(guard, [&] { return stopping || (current != nullptr && generation != seen); });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            Job& job = *current;
+            job.helpers++;
+            guard.unlock();
+            runBatches(job);
+            guard.lock();
+            job.helpers--;
+            done.notify_all();
+        }
+    }
+
+    vector<thread> workers;
+    mutex runLock; // Held by the caller whose work the pool is doing
+    mutex lock; // Guards the job and how far it has got
+    condition_variable wake, done;
+    Job* current = nullptr;
+    uint64_t generation = 0;
+    bool stopping = false;
+};
+
+/*
+WorldChanges holds what the players of a world have changed in it: the items of each room they have taken from or left
+in, and where the wandering characters are. A player who plays a world alone has changes of their own, in one shard
+that the WorldChanges holds itself. Players who share a world share its changes as well, split between SHARED_SHARDS
+shards by room index; a player holds the lock of their room's shard while they look at the room or change it, so
+players in rooms of different shards never wait for each other. Each shard also keeps the rooms of it that were
+rendered most recently, so a room is rendered once for every player who comes in, until its own items or characters change
+*/
+class WorldChanges {
+public:
+    static constexpr size_t SHARED_SHARDS = 64;
+
+    explicit WorldChanges(const World& world, size_t shardCount = 1)
+        : world(world), shardCount(shardCount), sharedShards(shardCount > 1 ? make_unique<Shard[]>(shardCount) : nullptr),
+          shards(shardCount > 1 ? sharedShards.get() : &ownShard), wandererRooms(world.getWanderers().size()),
+          wandererStays(wandererRooms.size()), wandererItems(wandererRooms.size()), nextOccupant(wandererRooms.size(), NO_OCCUPANT),
+          previousOccupant(wandererRooms.size(), NO_OCCUPANT) {
+        if (!wandererRooms.empty()) {
+            firstOccupant.assign(world.getRoomCount(), NO_OCCUPANT); // Only a world with wanderers needs to know who is in each room
+        }
+        for (size_t wanderer = 0; wanderer < wandererRooms.size(); wanderer++) {
+            uint32_t room = world.getWanderers()[wanderer].room;
+            wandererRooms[wanderer].store(room, memory_order_relaxed);
+            wandererItems[wanderer].store(world.getWandererItems()[wanderer], memory_order_relaxed);
+            addOccupant(room, static_cast<uint32_t>(wanderer));
+        }
+    }
+
+    const World& getWorld() const {
+        return world;
+    }
+
+    // The lock of the shard the room is in, held while the room's items or characters are used
+    mutex& shardOf(uint32_t room) const {
+        return shardFor(room).lock;
+    }
+
+    // The number of the shard the room is in
+    size_t shardIndex(uint32_t room) const {
+        return room % shardCount;
+    }
+
+    /*
+    Takes the first item with the name from the room into the inventory; returns false if the room has none.
+    A room is copied out of the image the first time an item is taken from it. The caller holds the room's shard lock
+    */
+    bool takeItem(uint32_t room, uint32_t itemName, Inventory& inventory) {
+        Shard& shard = shardFor(room);
+        auto it = shard.rooms.find(room);
+        if (it == shard.rooms.end()) {
+            Span<uint32_t> startItems = world.getItems(room);
+            if (itemName == NO_SYMBOL || find(startItems.begin(), startItems.end(), itemName) == startItems.end()) {
+                return false;
+            }
+            it = shard.rooms.emplace(room, RoomItems(startItems)).first;
+        }
+        if (!it->second.takeItem(itemName, inventory)) {
+            return false;
+        }
+        forgetRendered(shard, room);
+        return true;
+    }
+
+    // Leaves the item with the name from the inventory in the room; returns false if the player does not carry one
+    bool leaveItem(uint32_t room, uint32_t itemName, Inventory& inventory) {
+        if (none_of(inventory.begin(), inventory.end(), [&](const Item& item) { return item.getName() == itemName; })) {
+            return false;
+        }
+        Shard& shard = shardFor(room);
+        changeRoom(shard, room).leaveItem(itemName, inventory);
+        forgetRendered(shard, room);
+        return true;
+    }
+
+    // Puts back the items a saved game had in a room
+    void setItems(uint32_t room, const vector<uint32_t>& itemNames) {
+        Shard& shard = shardFor(room);
+        RoomItems& roomItems = changeRoom(shard, room);
+        roomItems.clearItems();
+        for (uint32_t itemName : itemNames) {
+            roomItems.addItem(itemName);
+        }
+        forgetRendered(shard, room);
+    }
+
+    // The number of items in the room
+    size_t itemCount(uint32_t room) const {
+        const Shard& shard = shardFor(room);
+        auto it = shard.rooms.find(room);
+        return it != shard.rooms.end() ? it->second.itemCount() : world.getItems(room).size();
+    }
+
+    // Calls visit with the symbol of each item in the room, in the order they are displayed
+    template <typename Visit>
+    void forEachItem(uint32_t room, Visit visit) const {
+        const Shard& shard = shardFor(room);
+        auto it = shard.rooms.find(room);
+        if (it != shard.rooms.end()) {
+            it->second.forEachItem(visit);
+        } else {
+            for (uint32_t itemName : world.getItems(room)) {
+                visit(itemName);
+            }
+        }
+    }
+
+    /*
+    Calls visit with each character in the room: those who never leave it, then the wanderers who are there, in the
+    order of their wander lines. The caller holds the lock of the room's shard
+    */
+    template <typename Visit>
+    void forEachCharacter(uint32_t room, Visit visit) const {
+        for (const Character& character : world.getCharacters(room)) {
+            visit(character);
+        }
+        if (firstOccupant.empty()) {
+            return;
+        }
+        for (uint32_t wanderer = firstOccupant[room]; wanderer != NO_OCCUPANT; wanderer = nextOccupant[wanderer]) {
+            visit(world.getWanderers()[wanderer]);
+        }
+    }
+
+    // The first character in the room with the name, or null if there is none
+    const Character* findCharacter(uint32_t room, uint32_t name) const {
+        const Character* found = nullptr;
+        forEachCharacter(room, [&](const Character& character) {
+            if (found == nullptr && character.name == name) {
+                found = &character;
+            }
+        });
+        return found;
+    }
+
+    /*
+    Builds the text a player is shown for the room into rendered, reusing its memory: the room's description, items,
+    directions the player can move, and characters. The caller holds the lock of the room's shard
+    */
+    void render(uint32_t room, string& rendered) const {
+        rendered = "---------------------------------------------\n";
+        rendered += world.getText(world.getLocation(room).description);
+        rendered += '\n';
+        if (itemCount(room) != 0) {
+            rendered += "You see the following items in the room:\n";
+            forEachItem(room, [&](uint32_t itemName) { // for each item in the room
+                rendered += "- "; // add the item
+                rendered += world.getName(itemName);
+                rendered += '\n';
+            });
+        }
+        rendered += "Available directions: ";
+        for (int direction = 0; direction < DirectionCount; direction++) { // for each compass direction
+            if (world.getExit(room, static_cast<Direction>(direction)) != NO_ROOM) {
+                rendered += DIRECTION_NAMES[direction]; // add the direction if there is a path that way
+                rendered += ' ';
+            }
+        }
+        rendered += "\nCharacters in the room: ";
+        forEachCharacter(room, [&](const Character& character) { // for each character in the room
+            rendered += world.getName(character.name); // add the character
+            size_t wanderer = world.wandererOf(character);
+            uint32_t item = wanderer != NO_WANDERER ? wandererItems[wanderer].load(memory_order_relaxed) : NO_SYMBOL;
+            if (item != NO_SYMBOL) {
+                rendered += " (carrying ";
+                rendered += world.getName(item);
+                rendered += ')';
+            }
+            rendered += ' ';
+        });
+        rendered += "\n---------------------------------------------\n";
+    }
+
+    /*
+    The text a player is shown for the room, rendered the first time it is shown and then kept, for every player of
+    these changes, until the room's items or characters change. A block is never changed while anyone else holds it, so
+    it can be written out after the lock is let go; a player lets go of the block they were shown last before asking for
+    another, so that if nobody else holds it either, it is rendered again in the same memory. The caller holds the lock
+    of the room's shard
+    */
+    shared_ptr<const string> renderedRoom(uint32_t room) {
+        Shard& shard = shardFor(room);
+        if (shard.rendered.empty()) { // Made the first time a room of the shard is shown, so that making the changes allocates nothing
+            shard.rendered.resize(shardCount > 1 ? SHARED_RENDERED_ROOMS : OWN_RENDERED_ROOMS);
+        }
+        RenderedRoom& slot = renderedSlot(shard, room);
+        if (slot.room != room || !slot.current) {
+            if (slot.text == nullptr || slot.text.use_count() > 1) {
+                slot.text = make_shared<string>(); // Another player is still writing the old block out
+            } else {
+                atomic_thread_fence(memory_order_acquire); // The last player to hold the block has finished reading it
+            }
+            render(room, *slot.text);
+            slot.room = room;
+            slot.current = true;
+        }
+        return slot.text;
+    }
+
+    // Calls visit with the index and items of each room whose items have changed, which a saved game keeps
+    template <typename Visit>
+    void forEachChangedRoom(Visit visit) const {
+        for (size_t shard = 0; shard < shardCount; shard++) {
+            for (const auto& room : shards[shard].rooms) {
+                visit(room.first, room.second);
+            }
+        }
+    }
+
+    size_t getChangedRoomCount() const {
+        size_t count = 0;
+        for (size_t shard = 0; shard < shardCount; shard++) {
+            count += shards[shard].rooms.size();
+        }
+        return count;
+    }
+
+    /*
+    A wandering character reacts to the player talking to them: they stay where they are for their next STAY_TICKS
+    ticks, to listen, and give the player the item they carry if the player's hands are free. Returns the symbol of the
+    item given, or NO_SYMBOL. The caller holds the lock of the wanderer's room's shard, so they cannot walk away
+    */
+    uint32_t talkTo(size_t wanderer, bool handsFree) {
+        wandererStays[wanderer].store(STAY_TICKS, memory_order_relaxed);
+        uint32_t item = handsFree ? wandererItems[wanderer].exchange(NO_SYMBOL, memory_order_relaxed) : NO_SYMBOL;
+        if (item != NO_SYMBOL) {
+            uint32_t room = wandererRooms[wanderer].load(memory_order_relaxed);
+            forgetRendered(shardFor(room), room); // They are no longer shown carrying it
+        }
+        return item;
+    }
+
+    /*
+    Moves the wandering characters: each one that is not staying to listen has a one in three chance of walking through
+    a random exit of their room, taking what they carry with them. The choices are worked out from the tick number and
+    the character, not from a random number generator that carries on from one tick to the next, so a resumed game only
+    needs the tick number to move them the same way, and the characters can be moved in any order. A world with many of
+    them moves them in batches on every core at once (see WorkerPool); each character's state is kept in arrays of its
+    own (room, stay and item), so a batch only reads and writes what it moves. In a shared world every player's command
+    is a tick, and a player who finds another already moving the characters lets that move count for both, so players
+    never wait for each other here
+    */
+    void tick() {
+        if (wandererRooms.empty()) {
+            return;
+        }
+        unique_lock<mutex> guard(wanderLock, try_to_lock);
+        if (!guard.owns_lock()) {
+            return;
+        }
+        ticks++;
+        auto moveBatch = [this](size_t first, size_t last) {
+            for (size_t wanderer = first; wanderer < last; wanderer++) {
+                act(wanderer);
+            }
+        };
+        if (wandererRooms.size() >= PARALLEL_WANDERERS) {
+            WorkerPool::shared().parallelFor(wandererRooms.size(), WANDERER_BATCH, moveBatch);
+        } else {
+            moveBatch(0, wandererRooms.size());
+        }
+    }
+
+    // The number of ticks and the state of each wandering character, which a saved game keeps
+    struct WandererState {
+        uint32_t room;
+        uint32_t stay; // The ticks the character stays where they are
+        uint32_t item; // What they carry, or NO_SYMBOL
+    };
+
+    uint32_t getTicks() const {
+        return ticks;
+    }
+
+    size_t getWandererCount() const {
+        return wandererRooms.size();
+    }
+
+    WandererState getWandererState(size_t wanderer) const {
+        return {wandererRooms[wanderer].load(memory_order_relaxed), wandererStays[wanderer].load(memory_order_relaxed),
+                wandererItems[wanderer].load(memory_order_relaxed)};
+    }
+
+    // Puts the wandering characters back as a saved game had them
+    void restoreWanderers(uint32_t savedTicks, const vector<WandererState>& states) {
+        ticks = savedTicks;
+        for (size_t wanderer = 0; wanderer < states.size(); wanderer++) {
+            moveWanderer(wanderer, states[wanderer].room);
+            wandererStays[wanderer].store(states[wanderer].stay, memory_order_relaxed);
+            wandererItems[wanderer].store(states[wanderer].item, memory_order_relaxed);
+        }
+    }
+
+    static constexpr uint32_t STAY_TICKS = 3;
+
+private:
+    /*
+    A room as it was rendered, and whether it still is that way. Each room of a shard has one slot it is kept in, which
+    it shares with other rooms of the shard; the room rendered last is the one that is kept
+    */
+    struct RenderedRoom {
+        uint32_t room = NO_ROOM;
+        bool current = false;
+        shared_ptr<string> text;
+    };
+
+    /*
+    A shard: its lock, the rooms of it whose items have changed, and the rooms of it rendered most recently. Each is on
+    its own cache line, so that players in different shards do not slow each other down
+    */
+    struct alignas(64) Shard {
+        mutex lock;
+        unordered_map<uint32_t, RoomItems> rooms;
+        vector<RenderedRoom> rendered;
+    };
+
+    Shard& shardFor(uint32_t room) const {
+        return shards[room % shardCount];
+    }
+
+    RenderedRoom& renderedSlot(Shard& shard, uint32_t room) const {
+        return shard.rendered[room / shardCount % shard.rendered.size()];
+    }
+
+    // The room has changed, so it is rendered again the next time it is shown; the caller holds the lock of its shard
+    void forgetRendered(Shard& shard, uint32_t room) {
+        if (!shard.rendered.empty()) {
+            RenderedRoom& slot = renderedSlot(shard, room);
+            if (slot.room == room) {
+                slot.current = false; // The block is kept, so it can be rendered again in the same memory
+            }
+        }
+    }
+
+    // The changed items of a room of the shard, copied out of the image the first time they change
+    RoomItems& changeRoom(Shard& shard, uint32_t room) {
+        auto it = shard.rooms.find(room);
+        if (it == shard.rooms.end()) {
+            it = shard.rooms.emplace(room, RoomItems(world.getItems(room))).first;
+        }
+        return it->second;
+    }
+
+    // What one wandering character does in a tick
+    void act(size_t wanderer) {
+        uint32_t stay = wandererStays[wanderer].load(memory_order_relaxed);
+        if (stay != 0) {
+            wandererStays[wanderer].compare_exchange_strong(stay, stay - 1, memory_order_relaxed); // Unless a player has just talked to them again
+            return;
+        }
+        uint64_t random = mix(static_cast<uint64_t>(ticks) << 32 | wanderer);
+        if (random % 3 != 0) {
+            return;
+        }
+        uint32_t room = wandererRooms[wanderer].load(memory_order_relaxed);
+        uint32_t exits[DirectionCount];
+        size_t exitCount = 0;
+        for (int direction = 0; direction < DirectionCount; direction++) {
+            if (world.getExit(room, static_cast<Direction>(direction)) != NO_ROOM) {
+                exits[exitCount++] = world.getExit(room, static_cast<Direction>(direction));
+            }
+        }
+        if (exitCount > 0) {
+            moveWanderer(wanderer, exits[random / 3 % exitCount]);
+        }
+    }
+
+    /*
+    Moves a wandering character to a room, holding the locks of both rooms' shards (once, if they are the same shard).
+    A wanderer's room, and the lists of who is in each room, are only changed under the locks of the rooms' shards, and
+    are only looked at under the lock of the room's shard
+    */
+    void moveWanderer(size_t wanderer, uint32_t room) {
+        uint32_t from = wandererRooms[wanderer].load(memory_order_relaxed);
+        unique_lock<mutex> fromGuard(shardOf(from), defer_lock), toGuard(shardOf(room), defer_lock);
+        if (fromGuard.mutex() == toGuard.mutex()) {
+            fromGuard.lock();
+        } else {
+            lock(fromGuard, toGuard);
+        }
+        if (from != room) {
+            removeOccupant(from, static_cast<uint32_t>(wanderer));
+            addOccupant(room, static_cast<uint32_t>(wanderer));
+            wandererRooms[wanderer].store(room, memory_order_relaxed);
+            forgetRendered(shardFor(from), from);
+            forgetRendered(shardFor(room), room);
+        }
+    }
+
+    /*
+    Each room has a list of the wanderers in it, linked through nextOccupant and previousOccupant, so a room's characters
+    are found without looking at every wanderer. A list is kept in the order of the wander lines, so a room shows its
+    characters in the same order however the batches of a tick were spread over the threads
+    */
+    void addOccupant(uint32_t room, uint32_t wanderer) {
+        uint32_t previous = NO_OCCUPANT;
+        uint32_t next = firstOccupant[room];
+        while (next != NO_OCCUPANT && next < wanderer) {
+            previous = next;
+            next = nextOccupant[next];
+        }
+        previousOccupant[wanderer] = previous;
+        nextOccupant[wanderer] = next;
+        (previous == NO_OCCUPANT ? firstOccupant[room] : nextOccupant[previous]) = wanderer;
+        if (next != NO_OCCUPANT) {
+            previousOccupant[next] = wanderer;
+        }
+    }
+
+    void removeOccupant(uint32_t room, uint32_t wanderer) {
+        uint32_t previous = previousOccupant[wanderer];
+        uint32_t next = nextOccupant[wanderer];
+        (previous == NO_OCCUPANT ? firstOccupant[room] : nextOccupant[previous]) = next;
+        if (next != NO_OCCUPANT) {
+            previousOccupant[next] = previous;
+        }
+    }
+
+    // Mixes the bits of a number so that numbers next to each other give unrelated results (the SplitMix64 finalizer)
+    static uint64_t mix(uint64_t number) {
+        number += 0x9E3779B97F4A7C15ULL;
+        number = (number ^ (number >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        number = (number ^ (number >> 27)) * 0x94D049BB133111EBULL;
+        return number ^ (number >> 31);
+    }
+
+    const World& world;
+    size_t shardCount;
+    Shard ownShard; // The only shard of changes that are not shared, so making them allocates nothing
+    unique_ptr<Shard[]> sharedShards;
+    Shard* shards; // ownShard, or sharedShards
+    /*
+    The wandering characters, each array indexed by wanderer: the room they are in, the ticks they stay there, and what
+    they carry. They are atomic, since a player in any shard can talk to a wanderer while a tick moves the others
+    */
+    vector<atomic<uint32_t>> wandererRooms;
+    vector<atomic<uint32_t>> wandererStays;
+    vector<atomic<uint32_t>> wandererItems;
+    static constexpr uint32_t NO_OCCUPANT = UINT32_MAX;
+    vector<uint32_t> firstOccupant; // For each room, its first wanderer
+    vector<uint32_t> nextOccupant, previousOccupant; // For each wanderer, the wanderers before and after them in their room
+    uint32_t ticks = 0;
+    mutex wanderLock; // Held while the wandering characters move
+    static constexpr size_t PARALLEL_WANDERERS = 16384; // Fewer wanderers than this are moved by the player's thread alone
+    static constexpr size_t WANDERER_BATCH = 4096;
+    static constexpr size_t OWN_RENDERED_ROOMS = 16; // The rooms kept rendered by changes one player has to themselves
+    static constexpr size_t SHARED_RENDERED_ROOMS = 256; // And by each shard of changes shared by many players
+};
+
+// A stream buffer that throws away what is written to it, for output nobody will read
+class DiscardingBuffer : public streambuf {
+protected:
+    int overflow(int character) override {
+        return traits_type::not_eof(character);
+    }
+
+    streamsize xsputn(const char*, streamsize count) override {
+        return count;
+    }
+};
+
+/*
+Control class conttols where the player is in the game and what they can do
+*/
+class Control {
+public:
+    /*
+    Each Control is one game session; it reads commands from input and writes everything it shows to output.
+    This session plays a world of its own, loaded from the world file or image (the default world if there is none)
+    */
+    Control(istream& input = cin, ostream& output = cout, const string& worldFile = "")
+        : ownWorld(in_place, worldFile, output), ownChanges(in_place, *ownWorld),
+          world(*ownWorld), changes(*ownChanges), currentRoom(world.getStart()), input(input), output(output) {
+        // The session holds everything a turn needs, so that neither starting it (in the default world) nor playing a
+        // turn needs to allocate memory
+    }
+
+    // This session joins a world, and the changes to it, that other sessions on other threads play at the same time
+    Control(WorldChanges& sharedChanges, istream& input, ostream& output)
+        : world(sharedChanges.getWorld()), changes(sharedChanges), currentRoom(world.getStart()), input(input), output(output) {
+    }
+
+    // This session plays a world that other sessions play too, but on its own: only the changes it makes are its own
+    Control(const World& sharedWorld, istream& input, ostream& output)
+        : ownChanges(in_place, sharedWorld), world(sharedWorld), changes(*ownChanges), currentRoom(world.getStart()),
+          input(input), output(output) {
+    }
+
+    void startGame() {
+        // Game loop, which runs until the game is over or the input is closed
+        while (playTurn()) {
+        }
+        finish();
+    }
+
+    // Ends the session: the saved game of a game that is over is removed
+    void finish() {
+        if (gameOver && journal.is_open()) {
+            forgetSavedGame(); // A finished game is not resumed
+        }
+        output.flush(); // Lines are not flushed one by one, so the end of the game is written out here
+    }
+
+    // Whether the game is being kept in a journal
+    bool isSaved() const {
+        return journal.is_open();
+    }
+
+    /*
+    Plays one turn: shows the room, then reads and carries out one command. Returns false once the game is over or the input is closed
+    */
+    bool playTurn() {
+        if (!prompt()) {
+            return false;
+        }
+        // Player input, read into the same string every turn so it keeps its memory
+        if (!getline(input, action)) {
+            return false; // The player has left the game
+        }
+        handleLine(action);
+        return true;
+    }
+
+    /*
+    The first half of a turn: shows the room, runs its turn triggers and asks for a command. Returns false if the game is
+    over, in which case no command is asked for. A session that is not given its commands by its input (as on the
+    server) calls this and handleLine itself instead of playTurn
+    */
+    bool prompt() {
+        if (gameOver) {
+            return false;
+        }
+        {
+            MEASURE(Metrics::Display);
+            showRoom(); // Display the current location
+        }
+
+        // The room's turn triggers run, which is where the world decides if the player has won
+        fire(TurnEvent, currentRoom);
+        if (gameOver) {
+            return false; // Only this session ends
+        }
+        output << "Enter a direction (north, east, south, or west), 'take <item>' to pick up an item, 'leave <item>' to leave an item, or 'talk <character>' to talk to a character: ";
+        return true;
+    }
+
+    // The second half of a turn: carries out the command the player typed
+    void handleLine(string_view line) {
+        Command command;
+        {
+            MEASURE(Metrics::Parse);
+            command = parseCommand(line);
+        }
+        if (carryOut(command)) {
+            changes.tick(); // The wandering characters move each time the player does something
+            if (journal.is_open()) {
+                record(command); // Commands that change the game are kept so it can be resumed (after the tick, which a checkpoint includes)
+            }
+        }
+    }
+
+    /*
+    Carries out one command. Returns true if it changed the game (the player moved, or took or left an item)
+    */
+    bool carryOut(const Command& command) {
+        if (command.verb == Verb::Stats) { // Show how the game engine is performing
+            writeStatistics(output);
+            return false;
+        }
+
+        MEASURE(COMMAND_OPERATIONS[static_cast<int>(command.verb)]);
+        if (command.verb == Verb::Take) { // Take an item
+            if (!inventory.empty()) { // Check if the player is already carrying an item
+                output << "You can only carry one item at a time. Leave the current item before taking another.\n";
+                return false;
+            }
+
+            bool success;
+            {
+                lock_guard<mutex> guard(changes.shardOf(currentRoom)); // Another player can be taking the same item
+                success = changes.takeItem(currentRoom, world.findSymbol(command.argument), inventory); // Take the item
+            }
+            if (!success) {
+                output << "Item not found in the room.\n"; // Item not found
+                return false;
+            }
+            fire(TakeEvent, inventory.back().getName());
+        } else if (command.verb == Verb::Leave) { // Leave an item
+            bool success;
+            {
+                lock_guard<mutex> guard(changes.shardOf(currentRoom));
+                success = changes.leaveItem(currentRoom, world.findSymbol(command.argument), inventory); // Leave the item
+            }
+            if (!success) {
+                output << "Item not found in the inventory.\n";
+                return false;
+            }
+        } else if (command.verb == Verb::Talk) { // Talk to a character
+            return talkToCharacter(command.argument); // Talking only changes the game, and is kept in the journal, if the character wanders
+        } else {
+            // Directly process the direction input
+            uint32_t nextRoom = world.getExit(currentRoom, parseDirection(command.argument)); // Move to the next location
+            if (nextRoom != NO_ROOM) { // If there is a path that way
+                currentRoom = nextRoom; // Move to the next location
+                fire(EnterEvent, currentRoom);
+            } else {
+                output << "Invalid direction. Please enter north, east, south, or west.\n";
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /*
+    Keeps this game in a journal file so it can be resumed after a restart. Any game already kept in the journal and
+    its checkpoint is restored first; from then on, every command that changes the game is added to the journal, and
+    every CHECKPOINT_INTERVAL commands the whole game is written to the checkpoint and the journal starts again.
+    Returns true if a game was restored. A saved game that cannot be restored as it was (its checkpoint is damaged or
+    missing, or the file is not a journal) is left as it is, and this game is not saved. Once the game is won or lost,
+    the journal and checkpoint are removed. The world file must not change between saving and resuming a game
+    */
+    bool resume(const string& journalFile) {
+        journalName = journalFile;
+        if (!ownChanges) {
+            return keepSavedGame("a game in a shared world is not saved"); // Other players change the world in ways the journal does not hold
+        }
+        ifstream saved(journalName);
+        string line;
+        bool hasJournal = static_cast<bool>(getline(saved, line)); // A journal that is missing or empty holds no commands
+        uint32_t journalGeneration = 0;
+        if (hasJournal && !readJournalHeader(line, journalGeneration)) {
+            return keepSavedGame("it is not a saved game");
+        }
+
+        // The checkpoint must be the one the journal continues from, or the one written just after it (the journal is then already in it)
+        CheckpointStatus checkpoint = hasJournal ? readCheckpoint(journalGeneration, journalGeneration + 1) : readCheckpoint(0, UINT32_MAX);
+        if (checkpoint == UnusableCheckpoint) {
+            return keepSavedGame("its checkpoint cannot be read");
+        }
+        if (checkpoint == NoCheckpoint && journalGeneration != 0) {
+            return keepSavedGame("its checkpoint is missing");
+        }
+
+        bool restored = checkpoint == RestoredCheckpoint;
+        bool current = hasJournal && journalGeneration == generation;
+        DiscardingBuffer discarded;
+        streambuf* shown = output.rdbuf(&discarded); // The player saw what these commands showed when they were played
+        while (current && getline(saved, line)) {
+            carryOut(parseCommand(line)); // Only commands that worked were kept, so they work again
+            changes.tick();
+            journalEntries++;
+            restored = true;
+        }
+        output.rdbuf(shown);
+        saved.close();
+
+        journal.open(journalName, current ? ios::app : ios::trunc);
+        if (!current) {
+            journal << journalHeader() << '\n';
+        }
+        if (!journal) {
+            output << "Unable to open " << journalName << ". The game will not be saved.\n";
+            journal.close();
+        }
+        return restored;
+    }
+
+/*
+The character says their dialogue, unless one of their talk triggers gets past its conditions and does something instead
+(the queen kills the player, and the caterpillar gives them a map). A wandering character then stays to listen, and
+gives the player what they carry if the player's hands are free. Returns true if the character was a wanderer, since
+that changes the game. The shard's lock is only held to find the character and take what they give; the triggers only
+look at the world and at this player, so they run after it is let go, and a map read from the disk stalls nobody else
+*/
+bool talkToCharacter(string_view characterName) {
+    uint32_t name = world.findSymbol(characterName); // The name is looked up once, and the characters are compared by its symbol
+    const Character* character = nullptr; // A record of the world, so it can be used once the lock is let go
+    size_t wanderer = NO_WANDERER;
+    uint32_t given = NO_SYMBOL;
+    {
+        lock_guard<mutex> guard(changes.shardOf(currentRoom)); // The characters can walk out of the room while the player talks to them
+        character = changes.findCharacter(currentRoom, name);
+        if (character != nullptr) {
+            wanderer = world.wandererOf(*character);
+            if (wanderer != NO_WANDERER) {
+                given = changes.talkTo(wanderer, inventory.empty());
+            }
+        }
+    }
+    if (character == nullptr) {
+        output << "Character not found in the room.\n"; // If the player tries to talk to a character that is not in the room
+        return false;
+    }
+    if (!fire(TalkEvent, character->name, character)) {
+        output << world.getText(character->dialogue) << '\n'; // The character gives the player advice
+    }
+    if (given != NO_SYMBOL) { // The item is only handed over now, so the triggers saw the player as they were
+        inventory.push_back(Item(given));
+        output << "The " << world.getName(character->name) << " gives you the " << world.getName(given) << ".\n";
+    }
+    return wanderer != NO_WANDERER;
+}
+
+void openMapsFile() { // Function to open the maps file
+    MEASURE(Metrics::ReadFile);
+    shared_ptr<const string> map = AssetCache::get("maps.txt"); // The map is shared by every game, so it is only read once
+    if (map) { // If the file could be read
+        output << *map;
+        if (!map->empty() && map->back() != '\n') {
+            output << '\n'; // Every line of the map ends a line on the screen
+        }
+    } else {
+        output << "Unable to open maps.txt.\n"; // If the file is not open, an error message is displayed
+    }
+}
+
+    // Function to read instructions from the file
+    void readInstructions() {
+        MEASURE(Metrics::ReadFile);
+        instructions = AssetCache::get("instructions.txt"); // The instructions are shared by every game, so they are only read once
+        if (!instructions) {
+            /*
+            The default instructions are used if the file is not open, since the game needs instructions
+            */
+            output << "Unable to open instructions.txt. Using default instructions.\n";
+            instructions = make_shared<const string>(
+                "Welcome to the Game!\n"
+                "Your goal is to find the key and reach the final room.\n"
+                "You can move between rooms using the directions north, east, south, or west.\n"
+                "Use 'take <item>' to pick up an item and 'leave <item>' to leave an item.\n"
+                "You can also 'talk <character>' to interact with characters in the room.\n");
+        } else if (!instructions->empty() && instructions->back() != '\n') {
+            instructions = make_shared<const string>(*instructions + '\n'); // Every line of the instructions ends a line on the screen
+        }
+    }
+
+    // Function to get the instructions
+    string_view getInstructions() const {
+        return instructions ? string_view(*instructions) : string_view(); // The instructions are returned
+    }
+
+    // Functions to look at the world without changing it
+    const World& getWorld() const {
+        return world;
+    }
+
+    const WorldChanges& getChanges() const {
+        return changes;
+    }
+
+    uint32_t getCurrentRoom() const {
+        return currentRoom;
+    }
+
+    const Inventory& getInventory() const {
+        return inventory;
+    }
+
+private:
+    /*
+    Runs the world's triggers for an event on a character, item or room; speaker is the character being talked to.
+    Returns false if no trigger did anything, either because the world has none for it or because none got past its conditions
+    */
+    bool fire(Event event, uint32_t subject, const Character* speaker = nullptr) {
+        bool acted = false;
+        for (const auto& trigger : world.getTriggers(event, subject)) {
+            if (trigger.event != event) {
+                continue; // The subject's triggers for the other event of its kind
+            }
+            acted = run(world.getCode(trigger), speaker) || acted;
+            if (gameOver) {
+                break;
+            }
+        }
+        return acted;
+    }
+
+    /*
+    Carries out a trigger's instructions in order, until one of its conditions does not hold or the game ends.
+    Returns true if it got as far as doing something
+    */
+    bool run(Span<Instruction> code, const Character* speaker) {
+        bool acted = false;
+        for (const auto& instruction : code) {
+            switch (instruction.op) {
+            case Op::RequireHolding:
+                if (!hasItem(instruction.operand)) {
+                    return acted;
+                }
+                break;
+            case Op::RequireIn:
+                if (currentRoom != instruction.operand) {
+                    return acted;
+                }
+                break;
+            case Op::Say:
+                output << world.getText(instruction.operand) << '\n';
+                break;
+            case Op::Dialogue:
+                if (speaker != nullptr) {
+                    output << world.getText(speaker->dialogue) << '\n';
+                }
+                break;
+            case Op::Map:
+                openMapsFile();
+                break;
+            case Op::Win:
+            case Op::Lose:
+                gameOver = true; // The game ends
+                return true;
+            }
+            acted = acted || (instruction.op != Op::RequireHolding && instruction.op != Op::RequireIn);
+        }
+        return acted;
+    }
+
+    // Adds a command to the journal in the same words every time, and writes a checkpoint when one is due
+    void record(const Command& command) {
+        if (command.verb == Verb::Move) {
+            journal << DIRECTION_NAMES[parseDirection(command.argument)] << '\n';
+        } else {
+            static const char* const verbs[] = {"", "take ", "leave ", "talk "}; // Talking is only kept when the character wanders
+            journal << verbs[static_cast<int>(command.verb)] << command.argument << '\n';
+        }
+        journal.flush(); // The command must be on disk before the player sees its result
+
+        if (++journalEntries >= CHECKPOINT_INTERVAL) {
+            writeCheckpoint();
+        }
+    }
+
+    /*
+    The checkpoint holds, in binary: the checkpoint's generation, the player's location, the inventory, the items of
+    each room that has changed since the world was loaded, and the tick number with where each wandering character is,
+    how long they stay and what they carry. It is written to a temporary file and renamed into place, so a restart
+    always finds a whole checkpoint. The journal then starts again under the new generation
+    */
+    void writeCheckpoint() {
+        string checkpointName = journalName + ".checkpoint";
+        journalEntries = 0; // If the checkpoint cannot be written, it is tried again after another CHECKPOINT_INTERVAL commands
+        {
+            ofstream checkpoint(checkpointName + ".tmp", ios::binary | ios::trunc);
+            writeNumber(checkpoint, CHECKPOINT_MAGIC);
+            writeNumber(checkpoint, generation + 1);
+            writeNumber(checkpoint, currentRoom);
+            writeNumber(checkpoint, inventory.size());
+            for (const auto& item : inventory) {
+                writeText(checkpoint, world.getName(item.getName()));
+            }
+            writeNumber(checkpoint, changes.getChangedRoomCount());
+            changes.forEachChangedRoom([&](uint32_t room, const RoomItems& roomItems) {
+                writeNumber(checkpoint, room);
+                writeNumber(checkpoint, roomItems.itemCount());
+                roomItems.forEachItem([&](uint32_t itemName) {
+                    writeText(checkpoint, world.getName(itemName));
+                });
+            });
+            writeNumber(checkpoint, changes.getTicks());
+            writeNumber(checkpoint, changes.getWandererCount());
+            for (size_t wanderer = 0; wanderer < changes.getWandererCount(); wanderer++) {
+                WorldChanges::WandererState state = changes.getWandererState(wanderer);
+                writeNumber(checkpoint, state.room);
+                writeNumber(checkpoint, state.stay);
+                writeNumber(checkpoint, state.item != NO_SYMBOL);
+                if (state.item != NO_SYMBOL) {
+                    writeText(checkpoint, world.getName(state.item));
+                }
+            }
+            if (!checkpoint.flush()) {
+                output << "Unable to write " << checkpointName << ".\n";
+                return; // The journal is kept as it is, so nothing is lost
+            }
+        }
+        error_code error;
+        filesystem::rename(checkpointName + ".tmp", checkpointName, error);
+        if (error) {
+            output << "Unable to write " << checkpointName << ".\n";
+            return;
+        }
+
+        generation++;
+        journal.close();
+        journal.open(journalName, ios::trunc);
+        journal << journalHeader() << '\n';
+        journal.flush();
+    }
+
+    enum CheckpointStatus { NoCheckpoint, RestoredCheckpoint, UnusableCheckpoint };
+
+    // Restores the game from the checkpoint, if there is one and its generation is from oldest to newest
+    CheckpointStatus readCheckpoint(uint32_t oldestGeneration, uint32_t newestGeneration) {
+        ifstream checkpoint(journalName + ".checkpoint", ios::binary);
+        if (!checkpoint.is_open()) {
+            return NoCheckpoint;
+        }
+        uint32_t roomCount = world.getRoomCount();
+
+        // Everything is read before anything is changed, so a damaged checkpoint leaves the game as it was
+        uint32_t magic = 0, savedGeneration = 0, location = 0, count = 0;
+        vector<uint32_t> savedInventory;
+        vector<pair<uint32_t, vector<uint32_t>>> savedRooms;
+        bool valid = readNumber(checkpoint, magic) && magic == CHECKPOINT_MAGIC && readNumber(checkpoint, savedGeneration)
+            && savedGeneration >= oldestGeneration && savedGeneration <= newestGeneration && readNumber(checkpoint, location) && location < roomCount && readNumber(checkpoint, count)
+            && count <= Inventory::CAPACITY;
+        for (uint32_t i = 0; valid && i < count; i++) {
+            savedInventory.emplace_back();
+            valid = readName(checkpoint, savedInventory.back());
+        }
+        valid = valid && readNumber(checkpoint, count);
+        for (uint32_t i = 0; valid && i < count; i++) {
+            uint32_t room = 0, itemCount = 0;
+            valid = readNumber(checkpoint, room) && room < roomCount && readNumber(checkpoint, itemCount);
+            savedRooms.emplace_back(room, vector<uint32_t>());
+            for (uint32_t j = 0; valid && j < itemCount; j++) {
+                savedRooms.back().second.emplace_back();
+                valid = readName(checkpoint, savedRooms.back().second.back());
+            }
+        }
+        uint32_t savedTicks = 0;
+        vector<WorldChanges::WandererState> savedWanderers;
+        valid = valid && readNumber(checkpoint, savedTicks) && readNumber(checkpoint, count) && count == changes.getWandererCount();
+        for (uint32_t i = 0; valid && i < count; i++) {
+            WorldChanges::WandererState state = {0, 0, NO_SYMBOL};
+            uint32_t carries = 0;
+            valid = readNumber(checkpoint, state.room) && state.room < roomCount && readNumber(checkpoint, state.stay)
+                && state.stay <= WorldChanges::STAY_TICKS && readNumber(checkpoint, carries) && carries <= 1
+                && (carries == 0 || readName(checkpoint, state.item));
+            savedWanderers.push_back(state);
+        }
+        if (!valid) {
+            return UnusableCheckpoint;
+        }
+
+        generation = savedGeneration;
+        currentRoom = location;
+        inventory.clear();
+        for (uint32_t name : savedInventory) {
+            inventory.push_back(Item(name));
+        }
+        for (const auto& room : savedRooms) {
+            changes.setItems(room.first, room.second);
+        }
+        changes.restoreWanderers(savedTicks, savedWanderers);
+        return RestoredCheckpoint;
+    }
+
+    // Leaves a saved game that cannot be resumed as it is, and plays this game without saving it
+    bool keepSavedGame(const string& reason) {
+        output << "Unable to resume the game saved in " << journalName << ": " << reason
+               << ". It has been kept as it is, and this game will not be saved.\n";
+        return false;
+    }
+
+    // Removes the journal and checkpoint of a game that has ended
+    void forgetSavedGame() {
+        journal.close();
+        error_code error;
+        filesystem::remove(journalName, error); // Without a journal, the checkpoint is restored on its own if it is left behind
+        filesystem::remove(journalName + ".checkpoint", error);
+        if (error) {
+            output << "Unable to remove " << journalName << ".checkpoint.\n";
+        }
+    }
+
+    // The first line of the journal, which says which checkpoint the journal continues from
+    string journalHeader() const {
+        return "# generation " + to_string(generation);
+    }
+
+    static bool readJournalHeader(const string& header, uint32_t& journalGeneration) {
+        istringstream words(header);
+        string mark, word;
+        return words >> mark >> word >> journalGeneration && mark == "#" && word == "generation";
+    }
+
+    /*
+    Numbers are kept as four bytes, lowest first, and text as its length followed by its characters
+    */
+    static void writeNumber(ostream& out, size_t number) {
+        for (int byte = 0; byte < 4; byte++) {
+            out.put(static_cast<char>((number >> (8 * byte)) & 0xFF));
+        }
+    }
+
+    static void writeText(ostream& out, string_view text) {
+        writeNumber(out, text.size());
+        out.write(text.data(), text.size());
+    }
+
+    static bool readNumber(istream& in, uint32_t& number) {
+        unsigned char bytes[4];
+        if (!in.read(reinterpret_cast<char*>(bytes), 4)) {
+            return false;
+        }
+        number = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | static_cast<uint32_t>(bytes[3]) << 24;
+        return true;
+    }
+
+    static bool readText(istream& in, string& text) {
+        uint32_t length = 0;
+        if (!readNumber(in, length) || length > MAX_NAME_LENGTH) {
+            return false;
+        }
+        text.resize(length);
+        return static_cast<bool>(in.read(&text[0], length));
+    }
+
+    // Reads the name of an item as text and finds its symbol; returns false if the world has no such name
+    bool readName(istream& in, uint32_t& symbol) const {
+        string name;
+        if (!readText(in, name)) {
+            return false;
+        }
+        symbol = world.findSymbol(name);
+        return symbol != NO_SYMBOL;
+    }
+
+    // Shows the player's room, as it was rendered for whoever saw it first since it last changed
+    void showRoom() {
+        {
+            lock_guard<mutex> guard(changes.shardOf(currentRoom)); // Other players can change the room while it is shown
+            shown.reset(); // So that if nobody else holds the room shown last, it can be rendered again in place
+            shown = changes.renderedRoom(currentRoom);
+        }
+        output.write(shown->data(), shown->size()); // The whole room is written at once, without the lock
+    }
+
+    // Function to check if the player has an item, by the symbol of its name
+    bool hasItem(uint32_t itemName) const {
+        for (const auto& item : inventory) { // The player's inventory is checked
+            if (item.getName() == itemName) { // If the item is found
+                return true; 
+            }
+        }
+        return false;
+    }
+
+    /*
+    The world this session plays and the changes made to it (both owned by the session, unless it shares them with
+    other sessions), and the room the player is in
+    */
+    optional<World> ownWorld;
+    optional<WorldChanges> ownChanges;
+    const World& world;
+    WorldChanges& changes;
+    uint32_t currentRoom;
+
+    /*
+    The state of this session: where it reads and writes, what the player carries, and whether the game has ended
+    */
+    istream& input;
+    ostream& output;
+    string action;
+    Inventory inventory;
+    bool gameOver = false;
+    shared_ptr<const string> instructions;
+
+    shared_ptr<const string> shown; // The player's room as it was last shown
+
+    /*
+    The journal and checkpoint of this session, if it is being saved: the checkpoint the journal continues from, and
+    how many commands the journal holds
+    */
+    static constexpr uint32_t CHECKPOINT_MAGIC = 0x32434C41; // "ALC2", since wanderers' stays and items are kept as well
+    static constexpr size_t CHECKPOINT_INTERVAL = 64;
+    static constexpr uint32_t MAX_NAME_LENGTH = 1 << 20;
+    string journalName;
+    ofstream journal;
+    uint32_t generation = 0;
+    size_t journalEntries = 0;
+
+#ifndef NO_METRICS
+    static constexpr Metrics::Operation COMMAND_OPERATIONS[] = {Metrics::Move, Metrics::Take, Metrics::Leave, Metrics::Talk};
+#endif
+};
+
+
+/*
+Game Class is used to run the game
+*/
+class Game {
+public:
+    /*
+    Prints the instructions then starts the game in the world file or image
+    */
+    void run(const string& worldFile = "world.txt", const string& journalFile = "", const string& statsFile = "") {
+        Control game(cin, cout, worldFile);
+        game.readInstructions(); // Only the interactive game needs the instructions
+        cout << game.getInstructions() << endl;
+        if (!journalFile.empty() && game.resume(journalFile)) {
+            cout << "Your saved game has been resumed.\n";
+        }
+        optional<StatsWriter> stats;
+        if (!statsFile.empty()) {
+            stats.emplace(statsFile);
+        }
+        game.startGame();
+    }
+};
+
+#ifdef __linux__
+/*
+Server plays many games at once for players who connect to a local socket ("--serve <socket>"), one session for each
+connection. Every session plays the same World, which is loaded once and only read; each has a Control and changes of
+its own, so what one player takes or leaves is theirs alone, and a session holds only the rooms its player has changed.
+With a directory for saved games, the first line a player sends is the name of their game, which is kept in a journal
+of that name in the directory and resumed the next time they connect with it (an empty line starts a game under a new
+name). A saved game is only played by one session at a time.
+A shared server ("--shared") instead has every session play one WorldChanges, so players see what the others take and
+leave. Each shard of it is owned by one worker (shard s by worker s % workers), and a session is played by the worker
+that owns the shard of the player's room: when a command takes the player into a room of another worker's shard, the
+session is handed to that worker, through a stack of arriving sessions that any worker can push onto without a lock,
+and the rest of the turn is played there. So the players of a shard are played one at a time by its worker, and the
+shard's lock is only ever contended when wandering characters move between shards.
+The connections are handed round robin to one worker thread per core, and each worker waits on an epoll of its own
+for the sessions it has been given. A session is only ever played by its worker, so nothing in it is locked. A session
+ends when its game is over or its player leaves, without ending any other; the server stops on SIGINT or SIGTERM
+*/
+class Server {
+public:
+    Server(const World& world, const string& socketPath, unsigned int workerCount, const string& journalDirectory = "",
+           bool shared = false)
+        : world(world), socketPath(socketPath), journalDirectory(journalDirectory), workers(max(workerCount, 1u)) {
+        if (shared) {
+            sharedChanges.emplace(world, WorldChanges::SHARED_SHARDS);
+        }
+    }
+
+    // Serves players until the server is stopped; returns false if the socket cannot be listened on
+    bool run() {
+        stopEvent = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        struct stat status;
+        if (stopEvent < 0 || listener < 0 || socketPath.size() >= sizeof(address.sun_path)) {
+            return false;
+        }
+        if (lstat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+            unlink(socketPath.c_str()); // Left behind by a server that was not stopped; anything else at the path is kept
+        }
+        copy(socketPath.begin(), socketPath.end(), address.sun_path);
+        if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, SOMAXCONN) != 0) {
+            return false;
+        }
+
+        struct sigaction stopping = {};
+        stopping.sa_handler = [](int) {
+            uint64_t one = 1;
+            (void)!write(stopEvent, &one, sizeof(one)); // All a signal handler may do is wake the threads up
+        };
+        sigaction(SIGINT, &stopping, nullptr);
+        sigaction(SIGTERM, &stopping, nullptr);
+
+        for (auto& worker : workers) {
+            worker.poll = epoll_create1(EPOLL_CLOEXEC);
+            worker.wake = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+            watch(worker.poll, worker.wake, EPOLLIN);
+            watch(worker.poll, stopEvent, EPOLLIN);
+            worker.serving = thread([this, &worker] { serve(worker); });
+        }
+        cout << "Serving " << world.getRoomCount() << " rooms on " << socketPath << " with " << workers.size() << " workers"
+             << (sharedChanges ? ", in one shared world" : "") << ".\n" << flush;
+
+        int poll = epoll_create1(EPOLL_CLOEXEC);
+        watch(poll, listener, EPOLLIN);
+        watch(poll, stopEvent, EPOLLIN);
+        size_t next = 0; // The worker the next connection is handed to
+        for (bool stopped = false; !stopped;) {
+            epoll_event events[2];
+            int count = epoll_wait(poll, events, 2, -1);
+            for (int i = 0; i < count; i++) {
+                if (events[i].data.fd == stopEvent) {
+                    stopped = true;
+                    continue;
+                }
+                int connection = accept4(listener, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (connection < 0) {
+                    if (errno == EMFILE || errno == ENFILE) {
+                        this_thread::sleep_for(chrono::milliseconds(10)); // Out of descriptors until some sessions end
+                    }
+                    continue;
+                }
+                // A session of the shared world starts with the worker that owns the first room's shard
+                Worker& worker = sharedChanges ? ownerOf(world.getStart()) : workers[next++ % workers.size()];
+                {
+                    lock_guard<mutex> guard(worker.lock);
+                    worker.arriving.push_back(connection);
+                }
+                uint64_t one = 1;
+                (void)!write(worker.wake, &one, sizeof(one));
+            }
+        }
+
+        for (auto& worker : workers) {
+            worker.serving.join();
+            close(worker.poll);
+            close(worker.wake);
+            for (int connection : worker.arriving) {
+                close(connection);
+            }
+            for (Session* session = worker.handedOver.exchange(nullptr); session != nullptr;) {
+                delete exchange(session, session->nextHandedOver); // Handed over as the workers stopped
+            }
+        }
+        close(poll);
+        close(listener);
+        close(stopEvent);
+        unlink(socketPath.c_str());
+        cout << "Served " << sessionCount.load() << " sessions.\n";
+        return true;
+    }
+
+private:
+    // What a session writes, kept until its socket takes it
+    class PendingOutput : public streambuf {
+    public:
+        string bytes;
+
+    protected:
+        int overflow(int character) override {
+            if (!traits_type::eq_int_type(character, traits_type::eof())) {
+                bytes.push_back(traits_type::to_char_type(character));
+            }
+            return traits_type::not_eof(character);
+        }
+
+        streamsize xsputn(const char* text, streamsize count) override {
+            bytes.append(text, count);
+            return count;
+        }
+    };
+
+    /*
+    One player's connection and game. The session is given the player's commands line by line, so its Control never
+    reads its input
+    */
+    struct Session {
+        Session(int connection, const World& world) : connection(connection), output(&pending), game(world, noInput, output) {}
+
+        // A session of the shared world
+        Session(int connection, WorldChanges& changes) : connection(connection), output(&pending), game(changes, noInput, output) {}
+
+        ~Session() {
+            close(connection);
+        }
+
+        int connection;
+        PendingOutput pending;
+        size_t sent = 0; // The bytes of pending that the socket has taken
+        ostream output;
+        istream noInput{nullptr};
+        Control game;
+        string incoming; // What the player has sent since the last whole line
+        string savedGame; // The name of the saved game the session plays, once the player has sent it
+        bool naming = false; // Waiting for the player to send the name of their saved game
+        bool ending = false; // The game is over, so the session ends once its output has been sent
+        bool writing = false; // The socket is full, so the worker waits to write instead of reading commands
+        Session* nextHandedOver = nullptr; // The session handed to the same worker before this one
+    };
+
+    struct Worker {
+        int poll = -1;
+        int wake = -1; // Written when connections arrive
+        mutex lock;
+        vector<int> arriving; // Connections handed to the worker that it has not started sessions for
+        atomic<Session*> handedOver{nullptr}; // Sessions of the shared world handed over by other workers, pushed without a lock
+        unordered_map<int, unique_ptr<Session>> sessions;
+        thread serving;
+    };
+
+    // The worker that plays the sessions of the shared world whose players are in the room
+    Worker& ownerOf(uint32_t room) {
+        return workers[sharedChanges->shardIndex(room) % workers.size()];
+    }
+
+    static void watch(int poll, int descriptor, uint32_t events, int operation = EPOLL_CTL_ADD) {
+        epoll_event event = {};
+        event.events = events;
+        event.data.fd = descriptor;
+        epoll_ctl(poll, operation, descriptor, &event);
+    }
+
+    // A worker plays the sessions it has been given until the server stops, then ends them
+    void serve(Worker& worker) {
+        epoll_event events[64];
+        for (bool stopped = false; !stopped;) {
+            int count = epoll_wait(worker.poll, events, 64, -1);
+            for (int i = 0; i < count; i++) {
+                int descriptor = events[i].data.fd;
+                if (descriptor == stopEvent) {
+                    stopped = true;
+                } else if (descriptor == worker.wake) {
+                    uint64_t woken;
+                    (void)!read(worker.wake, &woken, sizeof(woken));
+                    vector<int> arrived;
+                    {
+                        lock_guard<mutex> guard(worker.lock);
+                        arrived.swap(worker.arriving);
+                    }
+                    for (int connection : arrived) {
+                        start(worker, connection);
+                    }
+                    for (Session* session = worker.handedOver.exchange(nullptr, memory_order_acquire); session != nullptr;) {
+                        arrive(worker, *exchange(session, session->nextHandedOver));
+                    }
+                } else {
+                    auto it = worker.sessions.find(descriptor);
+                    if (it != worker.sessions.end()) {
+                        play(worker, *it->second, events[i].events);
+                    }
+                }
+            }
+        }
+        for (auto& session : worker.sessions) {
+            session.second->game.finish(); // A game that is over forgets its saved game, even if its last words were not sent
+        }
+        worker.sessions.clear(); // Closes every connection
+    }
+
+    void start(Worker& worker, int connection) {
+        unique_ptr<Session> started = sharedChanges ? make_unique<Session>(connection, *sharedChanges) : make_unique<Session>(connection, world);
+        Session& session = *worker.sessions.emplace(connection, std::move(started)).first->second;
+        sessionCount++;
+        watch(worker.poll, connection, EPOLLIN);
+        session.game.readInstructions();
+        session.output << session.game.getInstructions() << '\n';
+        if (!journalDirectory.empty()) {
+            session.naming = true;
+            session.output << NAME_PROMPT;
+        } else {
+            session.ending = !session.game.prompt();
+        }
+        sendOutput(worker, session);
+    }
+
+    /*
+    Takes the first line the player sends as the name of their saved game, and resumes the game saved under it, or
+    starts one. A name that is not made of letters, digits, - and _, or that another session is playing, is asked for
+    again. Returns false if the resumed game is already over
+    */
+    bool resumeSavedGame(Session& session, string_view line) {
+        string name(trim(line));
+        if (name.empty()) {
+            name = newSavedGameName();
+        }
+        if (name.size() > MAX_NAME || !all_of(name.begin(), name.end(), [](char letter) {
+                return (letter >= 'a' && letter <= 'z') || (letter >= 'A' && letter <= 'Z') || (letter >= '0' && letter <= '9')
+                       || letter == '-' || letter == '_';
+            })) {
+            session.output << "The name of a saved game is made of letters, digits, - and _.\n" << NAME_PROMPT;
+            return true;
+        }
+        {
+            lock_guard<mutex> guard(savedGamesLock);
+            if (!playing.insert(name).second) {
+                session.output << "The game saved as " << name << " is being played in another session.\n" << NAME_PROMPT;
+                return true;
+            }
+        }
+        session.savedGame = name;
+        session.naming = false;
+        if (session.game.resume(journalPath(name))) {
+            session.output << "Your saved game has been resumed.\n";
+        } else if (session.game.isSaved()) {
+            session.output << "Your game is saved as " << name << ". Send that name when you connect again to resume it.\n";
+        }
+        return session.game.prompt();
+    }
+
+    // A name for a new saved game that no other game has
+    string newSavedGameName() {
+        lock_guard<mutex> guard(savedGamesLock);
+        string name;
+        do {
+            ostringstream made;
+            made << "alice-" << hex << namer() % 0x1000000000000ULL;
+            name = made.str();
+        } while (playing.count(name) != 0 || filesystem::exists(journalPath(name)));
+        return name;
+    }
+
+    string journalPath(const string& name) const {
+        return (filesystem::path(journalDirectory) / (name + ".journal")).string();
+    }
+
+    // Carries out the whole lines the player has sent, or sends output the socket could not take before
+    void play(Worker& worker, Session& session, uint32_t events) {
+        if (events & (EPOLLERR | EPOLLHUP)) {
+            endSession(worker, session); // The player has gone
+            return;
+        }
+        if (events & EPOLLOUT) {
+            sendOutput(worker, session);
+            return;
+        }
+        char received[4096];
+        ssize_t count = read(session.connection, received, sizeof(received));
+        if (count <= 0) {
+            if (count == 0 || (errno != EAGAIN && errno != EINTR)) {
+                endSession(worker, session); // The player has left the game
+            }
+            return;
+        }
+        session.incoming.append(received, count);
+        if (!playLines(worker, session)) {
+            return; // Another worker plays the session now
+        }
+        if (session.incoming.size() > MAX_LINE) {
+            endSession(worker, session); // Nobody types a command this long
+            return;
+        }
+        sendOutput(worker, session);
+    }
+
+    /*
+    Carries out the whole lines the player has sent. Returns false if a command took the player of the shared world into
+    a shard of another worker, which the session has been handed to, so this worker must not touch it again
+    */
+    bool playLines(Worker& worker, Session& session) {
+        size_t begin = 0;
+        for (size_t end; !session.ending && (end = session.incoming.find('\n', begin)) != string::npos; begin = end + 1) {
+            string_view line = string_view(session.incoming).substr(begin, end - begin);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            if (session.naming) {
+                session.ending = !resumeSavedGame(session, line);
+                continue;
+            }
+            session.game.handleLine(line);
+            if (sharedChanges && &ownerOf(session.game.getCurrentRoom()) != &worker) {
+                session.incoming.erase(0, end + 1);
+                handOver(worker, session);
+                return false;
+            }
+            session.ending = !session.game.prompt();
+        }
+        session.incoming.erase(0, begin);
+        return true;
+    }
+
+    /*
+    Hands a session of the shared world to the worker that owns the shard of its player's room. The session leaves this
+    worker's epoll and sessions before it is pushed onto the other worker's stack, since from then on only that worker
+    uses it
+    */
+    void handOver(Worker& worker, Session& session) {
+        Worker& owner = ownerOf(session.game.getCurrentRoom());
+        epoll_ctl(worker.poll, EPOLL_CTL_DEL, session.connection, nullptr);
+        auto it = worker.sessions.find(session.connection);
+        it->second.release();
+        worker.sessions.erase(it);
+        Session* head = owner.handedOver.load(memory_order_relaxed);
+        do {
+            session.nextHandedOver = head;
+        } while (!owner.handedOver.compare_exchange_weak(head, &session, memory_order_release, memory_order_relaxed));
+        uint64_t one = 1;
+        (void)!write(owner.wake, &one, sizeof(one));
+    }
+
+    // Takes over a session handed over by another worker, and plays the rest of its turn and any lines it has waiting
+    void arrive(Worker& worker, Session& session) {
+        worker.sessions.emplace(session.connection, unique_ptr<Session>(&session));
+        watch(worker.poll, session.connection, EPOLLIN);
+        session.ending = !session.game.prompt();
+        if (playLines(worker, session)) {
+            sendOutput(worker, session);
+        }
+    }
+
+    /*
+    Sends the session's output. What the socket cannot take yet is kept, and the worker waits for the socket to have
+    room before it reads anything more from the player; a session whose game is over ends once all of it is sent
+    */
+    void sendOutput(Worker& worker, Session& session) {
+        string& bytes = session.pending.bytes;
+        while (session.sent < bytes.size()) {
+            ssize_t count = ::send(session.connection, bytes.data() + session.sent, bytes.size() - session.sent, MSG_NOSIGNAL);
+            if (count < 0 && errno == EINTR) {
+                continue;
+            }
+            if (count < 0 && errno == EAGAIN) {
+                if (!session.writing) {
+                    session.writing = true;
+                    watch(worker.poll, session.connection, EPOLLOUT, EPOLL_CTL_MOD);
+                }
+                return;
+            }
+            if (count < 0) {
+                endSession(worker, session);
+                return;
+            }
+            session.sent += count;
+        }
+        bytes.clear(); // Keeps its memory for the next turn
+        session.sent = 0;
+        if (session.ending) {
+            endSession(worker, session); // Only this session ends
+        } else if (session.writing) {
+            session.writing = false;
+            watch(worker.poll, session.connection, EPOLLIN, EPOLL_CTL_MOD);
+        }
+    }
+
+    // Ends a session, closing its connection; its saved game, unless the game is over, can then be resumed by another
+    void endSession(Worker& worker, Session& session) {
+        session.game.finish();
+        if (!session.savedGame.empty()) {
+            lock_guard<mutex> guard(savedGamesLock);
+            playing.erase(session.savedGame);
+        }
+        int connection = session.connection; // Kept, since erasing the session destroys it
+        worker.sessions.erase(connection);
+    }
+
+    static constexpr size_t MAX_LINE = 4096;
+    static constexpr size_t MAX_NAME = 64;
+    static constexpr char NAME_PROMPT[] = "Enter the name of your saved game, or an empty line to start a new one: ";
+    static inline int stopEvent = -1; // Written by the signal handler, which can only reach it through a global
+
+    const World& world;
+    optional<WorldChanges> sharedChanges; // The changes every session plays, if the world is shared
+    string socketPath;
+    string journalDirectory; // Where the sessions' games are saved, or empty if they are not
+    vector<Worker> workers;
+    int listener = -1;
+    atomic<size_t> sessionCount{0};
+    mutex savedGamesLock; // Guards playing and namer, which every worker uses
+    unordered_set<string> playing; // The names of the saved games being played
+    mt19937_64 namer{random_device{}()}; // Makes up the names of new saved games
+};
+#endif
+
+/*
+Returns the latency that the given fraction of the sorted latencies are at or below, by nearest rank: the
+ceil(fraction * n)th smallest, so the p99 of a short script is its slowest command rather than one from the middle
+*/
+double percentile(const vector<double>& sortedLatencies, double fraction) {
+    if (sortedLatencies.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(ceil(fraction * sortedLatencies.size()));
+    return sortedLatencies[min(max<size_t>(rank, 1), sortedLatencies.size()) - 1];
+}
+
+/*
+Replay class plays command scripts without a player, compares each transcript with its golden transcript,
+and reports how fast the commands ran. Every script is played in its own Control, spread over all the cores.
+A script can come with files named after it: <script>.world is the world it is played in, and <script>.journal
+is a saved game it resumes before its commands are played; the game it then saved is resumed once more at the end,
+and shown, so the golden transcript checks both resuming and saving
+*/
+class Replay {
+public:
+    /*
+    Collects the scripts to play; a directory stands for every script in it (the files that go with a script are skipped).
+    A script with no golden transcript fails, unless record is set, when its transcript becomes its golden transcript.
+    The scripts are played in the world file, or in the default world if worldFile is empty
+    */
+    Replay(const vector<string>& paths, bool record, const string& worldFile) : record(record), worldFile(worldFile) {
+        for (const auto& path : paths) {
+            if (filesystem::is_directory(path)) {
+                vector<string> directoryScripts;
+                for (const auto& entry : filesystem::directory_iterator(path)) {
+                    string extension = entry.path().extension().string();
+                    if (entry.is_regular_file() && extension != ".golden" && extension != ".world" && extension != ".journal") {
+                        directoryScripts.push_back(entry.path().string());
+                    }
+                }
+                sort(directoryScripts.begin(), directoryScripts.end()); // Directory order is not fixed, so the report order is made so
+                scripts.insert(scripts.end(), directoryScripts.begin(), directoryScripts.end());
+            } else {
+                scripts.push_back(path);
+            }
+        }
+    }
+
+    /*
+    Plays every script and prints one line per script; returns false if any transcript did not match its golden transcript
+    */
+    bool run() {
+        vector<Result> results(scripts.size());
+        atomic<size_t> nextScript{0};
+        vector<thread> workers;
+        unsigned int workerCount = max(1u, thread::hardware_concurrency());
+        for (unsigned int i = 0; i < workerCount; i++) {
+            workers.emplace_back([&] {
+                for (size_t index = nextScript++; index < scripts.size(); index = nextScript++) {
+                    results[index] = play(scripts[index], index);
+                }
+            });
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+
+        bool allPassed = true;
+        vector<double> allLatencies;
+        double totalSeconds = 0;
+        for (size_t i = 0; i < scripts.size(); i++) {
+            const Result& result = results[i];
+            cout << result.status << " " << scripts[i] << ": " << result.latencies.size() << " commands, "
+                 << commandsPerSecond(result.latencies.size(), result.seconds) << " commands/s, p50 "
+                 << percentile(result.latencies, 0.50) << " us, p99 " << percentile(result.latencies, 0.99) << " us\n";
+            allPassed = allPassed && (result.status == "PASS" || result.status == "NEW");
+            allLatencies.insert(allLatencies.end(), result.latencies.begin(), result.latencies.end());
+            totalSeconds += result.seconds;
+        }
+        sort(allLatencies.begin(), allLatencies.end());
+        cout << scripts.size() << " scripts, " << allLatencies.size() << " commands, "
+             << commandsPerSecond(allLatencies.size(), totalSeconds) << " commands/s per core, p50 "
+             << percentile(allLatencies, 0.50) << " us, p99 " << percentile(allLatencies, 0.99) << " us\n";
+        return allPassed;
+    }
+
+private:
+    /*
+    The outcome of one script: PASS, FAIL, MISSING when there is no golden transcript, or NEW when one has just been
+    recorded; the time each command took in microseconds, and the time the whole script took
+    */
+    struct Result {
+        string status;
+        vector<double> latencies;
+        double seconds = 0;
+    };
+
+    // Plays one script in a Control of its own and checks its transcript; index tells the script's saved game apart
+    Result play(const string& script, size_t index) const {
+        Result result;
+        ifstream commands(script);
+        if (!commands.is_open()) {
+            result.status = "FAIL"; // A missing script can never match its transcript
+            return result;
+        }
+        string scriptWorld = filesystem::exists(script + ".world") ? script + ".world" : worldFile;
+        string journalFile;
+        if (filesystem::exists(script + ".journal")) {
+            journalFile = (filesystem::temp_directory_path() / ("alice_replay_" + to_string(chrono::steady_clock::now().time_since_epoch().count())
+                           + "_" + to_string(index) + ".journal")).string();
+            filesystem::copy_file(script + ".journal", journalFile, filesystem::copy_options::overwrite_existing);
+        }
+
+        ostringstream transcript;
+        auto start = chrono::steady_clock::now();
+        {
+            Control game(commands, transcript, scriptWorld);
+            if (!journalFile.empty() && game.resume(journalFile)) {
+                transcript << "Your saved game has been resumed.\n";
+            }
+            auto turnStart = chrono::steady_clock::now();
+            while (game.playTurn()) {
+                auto turnEnd = chrono::steady_clock::now();
+                result.latencies.push_back(chrono::duration<double, micro>(turnEnd - turnStart).count());
+                turnStart = turnEnd;
+            }
+            result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        sort(result.latencies.begin(), result.latencies.end());
+
+        if (!journalFile.empty()) { // The game the script saved is resumed in a new session, which shows where it is
+            istringstream noCommands;
+            Control resumed(noCommands, transcript, scriptWorld);
+            if (resumed.resume(journalFile)) {
+                transcript << "Your saved game has been resumed.\n";
+            }
+            resumed.playTurn();
+            error_code error;
+            filesystem::remove(journalFile, error);
+            filesystem::remove(journalFile + ".checkpoint", error);
+        }
+
+        string goldenName = script + ".golden";
+        ifstream golden(goldenName);
+        if (golden.is_open()) {
+            ostringstream expected;
+            expected << golden.rdbuf();
+            result.status = expected.str() == transcript.str() ? "PASS" : "FAIL";
+        } else if (record) {
+            ofstream(goldenName) << transcript.str(); // What a new script shows is kept as what it should show from now on
+            result.status = "NEW";
+        } else {
+            result.status = "MISSING"; // A script that has never been checked cannot pass
+        }
+        return result;
+    }
+
+    static long long commandsPerSecond(size_t commands, double seconds) {
+        return seconds > 0 ? static_cast<long long>(commands / seconds) : 0;
+    }
+
+    vector<string> scripts; // The command scripts to play, in the order they are reported
+    bool record;
+    string worldFile;
+};
+
+/*
+Solver class finds the shortest list of commands that wins a world, or shows that the world cannot be won.
+It follows the world's triggers: entering or staying in a room and taking an item can win or lose the game,
+depending on where the player is and what they carry. A command that would lose is never chosen, and the first
+command that wins ends the search. The search goes best first (see solve) over the player's location and where the
+items that triggers ask about are, each state packed into a few words and kept in flat tables that are split by hash,
+so that a level of the search is expanded and its new states kept in parallel. Other items never matter (carrying one
+only stops the player taking an item that does), and talking is not searched, so the solver turns down a world where
+talking can win
+*/
+class Solver {
+public:
+    Solver(const Control& game) : game(game), world(game.getWorld()) {
+        readEndings();
+    }
+
+    /*
+    Returns why the solver cannot decide if the world can be won, or an empty string if it can
+    */
+    string unsupported() const {
+        size_t neededCount = 0;
+        for (uint32_t room = 0; room < world.getRoomCount(); room++) {
+            game.getChanges().forEachItem(room, [&](uint32_t itemName) {
+                neededCount += neededItems.count(itemName);
+            });
+        }
+        if (neededCount > MAX_NEEDED_ITEMS) {
+            return "its triggers ask about " + to_string(neededCount) + " items, and the search tells at most " + to_string(MAX_NEEDED_ITEMS) + " apart";
+        }
+        for (size_t wanderer = 0; wanderer < world.getWanderers().size(); wanderer++) {
+            if (world.getWandererItems()[wanderer] != NO_SYMBOL) {
+                return string(world.getName(world.getWanderers()[wanderer].name)) + " carries an item, and talking is not searched";
+            }
+        }
+        for (uint32_t subject = 0; subject < world.getSymbolCount(); subject++) {
+            for (const auto& trigger : world.getTriggers(TalkEvent, subject)) {
+                Ending ending;
+                if (trigger.event == TalkEvent && readEnding(world.getCode(trigger), ending) && ending.wins) {
+                    return "talking to " + string(world.getName(subject)) + " can win the game, and talking is not searched";
+                }
+            }
+        }
+        return "";
+    }
+
+    /*
+    Fills commands with the shortest winning list of commands; returns false if the world cannot be won.
+    The states are searched best first: in order of the fewest commands that a list going through them could win in,
+    which is the commands that reach them and then the estimate of the commands still needed (see estimate). States
+    that would take as many are searched a level at a time, a level being the states reached with the same number of
+    commands, so a level is searched in parallel as a breadth first search searches it. Since a command never lowers
+    that number, the first list of commands that wins is one of the shortest, and a state is never searched twice
+    */
+    bool solve(vector<string>& commands) {
+        // Every item that a trigger asks about, sorted by symbol so that items with the same name sit next to each other
+        for (uint32_t room = 0; room < world.getRoomCount(); room++) {
+            game.getChanges().forEachItem(room, [&](uint32_t itemName) {
+                if (neededItems.count(itemName) != 0) {
+                    itemNames.push_back(itemName);
+                }
+            });
+        }
+        sort(itemNames.begin(), itemNames.end());
+        State start(itemNames.size() + 1, 0);
+        start[0] = game.getCurrentRoom();
+        unordered_map<uint32_t, size_t> nextSlot; // The next place in the state for an item of each name
+        for (uint32_t room = 0; room < world.getRoomCount(); room++) {
+            game.getChanges().forEachItem(room, [&](uint32_t itemName) {
+                auto first = lower_bound(itemNames.begin(), itemNames.end(), itemName);
+                if (first != itemNames.end() && *first == itemName) {
+                    size_t slot = (first - itemNames.begin()) + nextSlot[itemName]++;
+                    start[slot + 1] = room;
+                }
+            });
+        }
+        sortSameItems(start);
+
+        statesExplored = 1;
+        Outcome startOutcome = outcome(TurnEvent, start[0], start); // The first turn can already end the game
+        if (startOutcome != Continues) {
+            return startOutcome == Won;
+        }
+
+        // Each field is wide enough for every room and for CARRIED (packed as the room count), and is never all ones
+        fieldBits = 1;
+        while ((uint64_t(1) << fieldBits) <= uint64_t(world.getRoomCount()) + 1) {
+            fieldBits++;
+        }
+        fieldsPerWord = 64 / fieldBits;
+        stateWords = (start.size() + fieldsPerWord - 1) / fieldsPerWord;
+        findGoals(start);
+        uint64_t startEstimate = estimate(start);
+        if (startEstimate == UNREACHABLE) {
+            return false;
+        }
+
+        partitions.assign(SEARCH_PARTITIONS, Partition());
+        vector<uint64_t> packedStart(stateWords);
+        pack(start, packedStart.data());
+        uint64_t startHash = hashState(packedStart.data());
+        insert(partitions[partitionOf(startHash)], packedStart.data(), startHash, 0);
+        parents.assign(1, 0);
+        moves.assign(1, 0);
+        map<uint64_t, Waiting> waiting; // The states to search, by the fewest commands a list going through them could win in
+        waiting[startEstimate].add(packedStart.data(), stateWords, 0, 0);
+
+        WorkerPool& pool = WorkerPool::shared();
+        vector<Batch> batches;
+        vector<size_t> firstNew;
+        while (!waiting.empty()) {
+            uint64_t least = waiting.begin()->first;
+            Waiting bucket = std::move(waiting.begin()->second);
+            waiting.erase(waiting.begin());
+            vector<uint32_t> order(bucket.numbers.size()); // By level, and then in the order the states were numbered
+            iota(order.begin(), order.end(), 0);
+            stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return bucket.levels[a] < bucket.levels[b]; });
+
+            Waiting level, nextLevel; // The states of the level being searched, and those of the next level that take as many commands
+            size_t nextWaiting = 0;
+            uint32_t commandCount = bucket.levels[order[0]];
+            bool wonLater = false; // Whether a command wins with one more command than the bucket's, and which is the first
+            size_t laterState = 0;
+            Command laterCommand = 0;
+            while (true) {
+                level.clear();
+                for (; nextWaiting < order.size() && bucket.levels[order[nextWaiting]] == commandCount; nextWaiting++) {
+                    level.add(&bucket.states[order[nextWaiting] * stateWords], stateWords, bucket.numbers[order[nextWaiting]], commandCount);
+                }
+                level.append(nextLevel); // Numbered after every state that was waiting
+                nextLevel.clear();
+                if (level.numbers.empty()) {
+                    if (nextWaiting == order.size()) {
+                        break;
+                    }
+                    commandCount = bucket.levels[order[nextWaiting]];
+                    continue;
+                }
+
+                size_t levelSize = level.numbers.size();
+                size_t batchCount = (levelSize + SEARCH_BATCH - 1) / SEARCH_BATCH;
+                if (batches.size() < batchCount) {
+                    batches.resize(batchCount);
+                }
+                auto expandBatches = [&](size_t first, size_t last) {
+                    State state, next;
+                    for (size_t batch = first; batch < last; batch++) {
+                        expand(batches[batch], level, batch * SEARCH_BATCH, min(levelSize, (batch + 1) * SEARCH_BATCH), commandCount, state, next);
+                    }
+                };
+                pool.parallelFor(batchCount, 1, expandBatches);
+
+                for (size_t batch = 0; batch < batchCount; batch++) {
+                    const Batch& found = batches[batch];
+                    if (found.won && commandCount + 1 <= least) { // The first state of the level that can win, as the states are numbered
+                        return tellCommands(found.winningState, found.winningCommand, commands);
+                    }
+                    if (found.won && !wonLater) {
+                        wonLater = true;
+                        laterState = found.winningState;
+                        laterCommand = found.winningCommand;
+                    }
+                }
+
+                auto keepNewStates = [&](size_t first, size_t last) {
+                    for (size_t partition = first; partition < last; partition++) {
+                        for (size_t batch = 0; batch < batchCount; batch++) {
+                            Batch& found = batches[batch];
+                            for (uint32_t at = found.partitionStarts[partition]; at < found.partitionStarts[partition + 1]; at++) {
+                                uint32_t step = found.order[at];
+                                found.kept[step] = insert(partitions[partition], &found.states[step * stateWords], found.hashes[step], commandCount + 1);
+                            }
+                        }
+                    }
+                };
+                pool.parallelFor(SEARCH_PARTITIONS, 1, keepNewStates);
+
+                auto countKept = [&](size_t first, size_t last) {
+                    for (size_t batch = first; batch < last; batch++) {
+                        batches[batch].keptCount = count(batches[batch].kept.begin(), batches[batch].kept.end(), 1);
+                    }
+                };
+                pool.parallelFor(batchCount, 1, countKept);
+                firstNew.assign(batchCount + 1, parents.size());
+                for (size_t batch = 0; batch < batchCount; batch++) {
+                    firstNew[batch + 1] = firstNew[batch] + batches[batch].keptCount;
+                }
+                if (firstNew[batchCount] > UINT32_MAX) {
+                    throw length_error("The solver reached more states than it can number");
+                }
+                parents.resize(firstNew[batchCount]);
+                moves.resize(firstNew[batchCount]);
+                auto number = [&](size_t first, size_t last) {
+                    for (size_t batch = first; batch < last; batch++) {
+                        const Batch& found = batches[batch];
+                        size_t next = firstNew[batch];
+                        for (size_t step = 0; step < found.kept.size(); step++) {
+                            if (found.kept[step]) {
+                                parents[next] = found.parents[step];
+                                moves[next] = found.commands[step];
+                                next++;
+                            }
+                        }
+                    }
+                };
+                pool.parallelFor(batchCount, 1, number);
+                for (size_t batch = 0; batch < batchCount; batch++) { // Each new state waits for its bucket, in the order they are numbered
+                    const Batch& found = batches[batch];
+                    size_t next = firstNew[batch];
+                    for (size_t step = 0; step < found.kept.size(); step++) {
+                        if (found.kept[step]) {
+                            Waiting& to = found.estimates[step] == least ? nextLevel : waiting[found.estimates[step]];
+                            to.add(&found.states[step * stateWords], stateWords, static_cast<uint32_t>(next++), commandCount + 1);
+                        }
+                    }
+                }
+                statesExplored = parents.size();
+                commandCount++;
+            }
+            if (wonLater) { // No list of commands wins in as few as the bucket's, so one more is the fewest
+                return tellCommands(laterState, laterCommand, commands);
+            }
+        }
+        return false;
+    }
+
+    size_t getStatesExplored() const {
+        return statesExplored;
+    }
+
+private:
+    /*
+    A state is the player's location followed by the location of each needed item (CARRIED if the player has it).
+    The search keeps it packed into stateWords words of fieldsPerWord fields of fieldBits bits each
+    */
+    typedef vector<uint32_t> State;
+    static constexpr uint32_t CARRIED = UINT32_MAX;
+
+    /*
+    A command is a small number: a direction, or after the directions taking and then leaving each needed item in turn
+    */
+    typedef uint8_t Command;
+    static constexpr size_t MAX_NEEDED_ITEMS = (UINT8_MAX + 1 - DirectionCount) / 2;
+    static constexpr size_t MAX_STATE_WORDS = MAX_NEEDED_ITEMS + 1;
+
+    static constexpr Command takeCommand(size_t item) {
+        return static_cast<Command>(DirectionCount + 2 * item);
+    }
+
+    static constexpr Command leaveCommand(size_t item) {
+        return static_cast<Command>(DirectionCount + 2 * item + 1);
+    }
+
+    string commandName(Command command) const {
+        if (command < DirectionCount) {
+            return string(DIRECTION_NAMES[command]);
+        }
+        size_t item = (command - DirectionCount) / 2;
+        return ((command - DirectionCount) % 2 == 0 ? "take " : "leave ") + string(world.getName(itemNames[item]));
+    }
+
+    enum Outcome { Continues, Won, Lost };
+
+    /*
+    A way to win: reaching a room (or any room, NO_ROOM) while holding an item (or none, NO_SYMBOL), or taking the item.
+    Each goal's room is a landmark
+    */
+    struct Goal {
+        uint32_t room;
+        uint32_t item;
+        bool byTaking;
+        size_t landmark;
+    };
+    static constexpr uint64_t UNREACHABLE = UINT64_MAX / 4; // An estimate of a state that cannot win, which adds without overflowing
+    static constexpr uint32_t NO_PATH = UINT32_MAX;
+
+    /*
+    The states reached so far whose hashes fall in one partition, in a table with open addressing: stateWords words
+    for each slot, in which an empty slot's first word is EMPTY_SLOT (which no state's first word can be, since its first
+    field is a room), and the fewest commands the state has been reached with. The table grows once it is three
+    quarters full
+    */
+    struct Partition {
+        vector<uint64_t> slots;
+        vector<uint32_t> levels;
+        size_t slotCount = 0;
+        size_t used = 0;
+    };
+    static constexpr uint64_t EMPTY_SLOT = UINT64_MAX;
+    static constexpr uint32_t NOT_REACHED = UINT32_MAX;
+    static constexpr size_t SEARCH_PARTITIONS = 64;
+    static constexpr size_t SEARCH_BATCH = 4096; // The states of a level expanded together
+    static constexpr size_t FIRST_SLOTS = 1024;
+
+    /*
+    States waiting to be searched: each packed, with its number and the number of commands it was reached with
+    */
+    struct Waiting {
+        vector<uint64_t> states;
+        vector<uint32_t> numbers;
+        vector<uint32_t> levels;
+
+        void add(const uint64_t* state, size_t words, uint32_t number, uint32_t level) {
+            states.insert(states.end(), state, state + words);
+            numbers.push_back(number);
+            levels.push_back(level);
+        }
+
+        void append(const Waiting& other) {
+            states.insert(states.end(), other.states.begin(), other.states.end());
+            numbers.insert(numbers.end(), other.numbers.begin(), other.numbers.end());
+            levels.insert(levels.end(), other.levels.begin(), other.levels.end());
+        }
+
+        void clear() {
+            states.clear();
+            numbers.clear();
+            levels.clear();
+        }
+    };
+
+    /*
+    What expanding a batch of a level finds: the new states (packed, with their hashes, the states they come from, the
+    commands that reach them and the fewest commands a list going through them could win in) in the order they were
+    found, and the order to take them in partition by partition; or the first command that wins
+    */
+    struct Batch {
+        vector<uint64_t> states;
+        vector<uint64_t> hashes;
+        vector<uint32_t> parents;
+        vector<Command> commands;
+        vector<uint64_t> estimates;
+        vector<uint32_t> partitionStarts; // Where each partition's steps start in order
+        vector<uint32_t> order;
+        vector<uint8_t> kept; // Whether each step reached a state with fewer commands than any step before it
+        size_t keptCount = 0;
+        bool won = false;
+        size_t winningState = 0;
+        Command winningCommand = 0;
+    };
+
+    /*
+    Expands the states first to last of the level, which were reached with commandCount commands: every state the
+    player can reach with one more command that had not been reached with as few, and from which the game can be won
+    */
+    void expand(Batch& batch, const Waiting& level, size_t first, size_t last, uint32_t commandCount, State& state, State& next) const {
+        batch.states.clear();
+        batch.hashes.clear();
+        batch.parents.clear();
+        batch.commands.clear();
+        batch.estimates.clear();
+        batch.won = false;
+        uint64_t packed[MAX_STATE_WORDS];
+        for (size_t current = first; current < last && !batch.won; current++) {
+            const uint64_t* waiting = &level.states[current * stateWords];
+            uint64_t waitingHash = hashState(waiting);
+            if (levelOf(partitions[partitionOf(waitingHash)], waiting, waitingHash) < commandCount) {
+                continue; // It was reached with fewer commands while it waited, and is searched from there
+            }
+            unpack(waiting, state);
+            forEachStep(state, next, [&](Command command, Outcome result) {
+                if (batch.won || result == Lost) {
+                    return; // A command that loses the game is never part of the answer
+                }
+                if (result == Won) {
+                    batch.won = true;
+                    batch.winningState = level.numbers[current];
+                    batch.winningCommand = command;
+                    return;
+                }
+                uint64_t commandsLeft = estimate(next);
+                if (commandsLeft == UNREACHABLE) {
+                    return; // The game can never be won from there
+                }
+                pack(next, packed);
+                uint64_t hash = hashState(packed);
+                if (levelOf(partitions[partitionOf(hash)], packed, hash) <= commandCount + 1) {
+                    return; // Only states not reached with as few commands before are searched
+                }
+                batch.states.insert(batch.states.end(), packed, packed + stateWords);
+                batch.hashes.push_back(hash);
+                batch.parents.push_back(level.numbers[current]);
+                batch.commands.push_back(command);
+                batch.estimates.push_back(commandCount + 1 + commandsLeft);
+            });
+        }
+
+        batch.partitionStarts.assign(SEARCH_PARTITIONS + 1, 0);
+        for (uint64_t hash : batch.hashes) {
+            batch.partitionStarts[partitionOf(hash) + 1]++;
+        }
+        for (size_t partition = 0; partition < SEARCH_PARTITIONS; partition++) {
+            batch.partitionStarts[partition + 1] += batch.partitionStarts[partition];
+        }
+        batch.order.resize(batch.hashes.size());
+        vector<uint32_t> placed(batch.partitionStarts.begin(), batch.partitionStarts.end() - 1);
+        for (size_t step = 0; step < batch.hashes.size(); step++) {
+            batch.order[placed[partitionOf(batch.hashes[step])]++] = static_cast<uint32_t>(step);
+        }
+        batch.kept.assign(batch.hashes.size(), 0);
+    }
+
+    // Fills commands with the commands that reach the numbered state, and then the command that wins from it
+    bool tellCommands(size_t state, Command winning, vector<string>& commands) const {
+        commands.push_back(commandName(winning));
+        for (size_t back = state; back != 0; back = parents[back]) {
+            commands.push_back(commandName(moves[back]));
+        }
+        reverse(commands.begin(), commands.end());
+        return true;
+    }
+
+    /*
+    Reads the ways the world can be won (a trigger that wins on entering or staying in a room, perhaps while holding
+    an item, or on taking an item) and finds, for each landmark room (the rooms they are won in and the rooms the needed
+    items start in), how many moves it takes to reach it from every room. The moves ignore the triggers, so they are
+    never more than it really takes
+    */
+    void findGoals(const State& start) {
+        auto addLandmark = [&](uint32_t room) {
+            auto known = find(landmarkRooms.begin(), landmarkRooms.end(), room);
+            if (known != landmarkRooms.end()) {
+                return static_cast<size_t>(known - landmarkRooms.begin());
+            }
+            landmarkRooms.push_back(room);
+            return landmarkRooms.size() - 1;
+        };
+        for (Event event : {TakeEvent, EnterEvent, TurnEvent}) {
+            for (const auto& [subject, subjectEndings] : endings[event]) {
+                for (const Ending& ending : subjectEndings) {
+                    uint32_t room = isRoomEvent(event) ? subject : NO_ROOM;
+                    uint32_t item = event == TakeEvent ? subject : NO_SYMBOL;
+                    bool possible = ending.wins;
+                    for (uint32_t required : ending.rooms) {
+                        possible = possible && (room == NO_ROOM || room == required);
+                        room = required;
+                    }
+                    for (uint32_t required : ending.items) {
+                        possible = possible && (item == NO_SYMBOL || item == required); // Only one item is ever carried
+                        item = required;
+                    }
+                    if (possible) {
+                        goals.push_back({room, item, event == TakeEvent, room != NO_ROOM ? addLandmark(room) : 0});
+                    }
+                }
+            }
+        }
+        for (size_t i = 1; i < start.size(); i++) {
+            addLandmark(start[i]);
+        }
+
+        vector<vector<uint32_t>> entrances(world.getRoomCount()); // The rooms each room can be entered from
+        for (uint32_t room = 0; room < world.getRoomCount(); room++) {
+            for (int direction = 0; direction < DirectionCount; direction++) {
+                uint32_t next = world.getExit(room, static_cast<Direction>(direction));
+                if (next != NO_ROOM) {
+                    entrances[next].push_back(room);
+                }
+            }
+        }
+        movesTo.assign(landmarkRooms.size(), vector<uint32_t>());
+        auto findMoves = [&](size_t first, size_t last) {
+            for (size_t landmark = first; landmark < last; landmark++) {
+                vector<uint32_t>& toLandmark = movesTo[landmark];
+                toLandmark.assign(world.getRoomCount(), NO_PATH);
+                vector<uint32_t> queue{landmarkRooms[landmark]};
+                toLandmark[landmarkRooms[landmark]] = 0;
+                for (size_t next = 0; next < queue.size(); next++) {
+                    for (uint32_t from : entrances[queue[next]]) {
+                        if (toLandmark[from] == NO_PATH) {
+                            toLandmark[from] = toLandmark[queue[next]] + 1;
+                            queue.push_back(from);
+                        }
+                    }
+                }
+            }
+        };
+        WorkerPool::shared().parallelFor(landmarkRooms.size(), 1, findMoves);
+    }
+
+    /*
+    The fewest moves it could take to get from one room to another: at least as many as it takes to reach any landmark
+    from the first room less the moves from the second room to that landmark, since the second room is on a way there
+    */
+    uint64_t leastMoves(uint32_t from, uint32_t to) const {
+        uint64_t least = 0;
+        for (const auto& toLandmark : movesTo) {
+            if (toLandmark[to] != NO_PATH) {
+                if (toLandmark[from] == NO_PATH) {
+                    return UNREACHABLE; // The landmark can be reached from the second room but not the first
+                }
+                least = max<uint64_t>(least, toLandmark[from] > toLandmark[to] ? toLandmark[from] - toLandmark[to] : 0);
+            }
+        }
+        return least;
+    }
+
+    /*
+    The fewest commands that could possibly win from the state, or UNREACHABLE if none can: for each goal, the moves
+    to an item it needs, one command to take it, and the moves from there to the room it is won in. A command changes
+    the estimate by one at most, which is what lets the search leave out states whose estimate is too high
+    */
+    uint64_t estimate(const State& state) const {
+        uint64_t least = UNREACHABLE;
+        int held = carried(state);
+        for (const Goal& goal : goals) {
+            auto movesToGoal = [&](uint32_t room) -> uint64_t {
+                if (goal.room == NO_ROOM) {
+                    return 0;
+                }
+                uint32_t moves = movesTo[goal.landmark][room];
+                return moves == NO_PATH ? UNREACHABLE : moves;
+            };
+            uint64_t commands = UNREACHABLE;
+            if (goal.item == NO_SYMBOL) {
+                commands = movesToGoal(state[0]);
+            } else if (held >= 0 && itemNames[held] == goal.item) {
+                commands = goal.byTaking ? 2 : movesToGoal(state[0]); // One taken to win must be left and taken again
+            } else {
+                for (size_t i = 0; i < itemNames.size(); i++) {
+                    if (itemNames[i] == goal.item && state[i + 1] != CARRIED) {
+                        uint64_t toItem = leastMoves(state[0], state[i + 1]);
+                        uint64_t fromItem = goal.byTaking ? 0 : movesToGoal(state[i + 1]);
+                        if (toItem != UNREACHABLE && fromItem != UNREACHABLE) {
+                            commands = min(commands, toItem + 1 + fromItem);
+                        }
+                    }
+                }
+            }
+            least = min(least, commands);
+        }
+        return least;
+    }
+
+    /*
+    Calls visit(command, outcome) for each command the player can give in the state, in the order the search tries
+    them, with next set to the state the command leads to
+    */
+    template <typename Visit>
+    void forEachStep(const State& state, State& next, Visit visit) const {
+        int held = carried(state);
+        for (int direction = 0; direction < DirectionCount; direction++) {
+            uint32_t room = world.getExit(state[0], static_cast<Direction>(direction));
+            if (room != NO_ROOM) {
+                next = state;
+                next[0] = room;
+                Outcome result = outcome(EnterEvent, room, next);
+                if (result == Continues) {
+                    result = outcome(TurnEvent, room, next);
+                }
+                visit(static_cast<Command>(direction), result);
+            }
+        }
+        for (size_t i = 0; i < itemNames.size(); i++) {
+            if (held < 0 && state[i + 1] == state[0]) { // The player can only carry one item at a time
+                next = state;
+                next[i + 1] = CARRIED;
+                sortSameItems(next);
+                Outcome result = outcome(TakeEvent, itemNames[i], next);
+                if (result == Continues) {
+                    result = outcome(TurnEvent, state[0], next);
+                }
+                visit(takeCommand(i), result);
+            } else if (held == static_cast<int>(i)) {
+                next = state;
+                next[i + 1] = state[0];
+                sortSameItems(next);
+                visit(leaveCommand(i), outcome(TurnEvent, state[0], next));
+            }
+        }
+    }
+
+    void pack(const State& state, uint64_t* packed) const {
+        fill(packed, packed + stateWords, 0);
+        for (size_t field = 0; field < state.size(); field++) {
+            uint64_t value = state[field] == CARRIED ? world.getRoomCount() : state[field];
+            packed[field / fieldsPerWord] |= value << (field % fieldsPerWord * fieldBits);
+        }
+    }
+
+    void unpack(const uint64_t* packed, State& state) const {
+        state.resize(itemNames.size() + 1);
+        uint64_t mask = (uint64_t(1) << fieldBits) - 1;
+        for (size_t field = 0; field < state.size(); field++) {
+            uint32_t value = static_cast<uint32_t>(packed[field / fieldsPerWord] >> (field % fieldsPerWord * fieldBits) & mask);
+            state[field] = value == world.getRoomCount() ? CARRIED : value;
+        }
+    }
+
+    uint64_t hashState(const uint64_t* packed) const {
+        uint64_t hash = 0;
+        for (size_t word = 0; word < stateWords; word++) {
+            hash = (hash ^ packed[word]) + 0x9E3779B97F4A7C15ull; // Mixed as splitmix64 mixes
+            hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+            hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+            hash ^= hash >> 31;
+        }
+        return hash;
+    }
+
+    // The partition a state's hash falls in is the top bits of the hash; its slot in the partition, the bottom bits
+    static size_t partitionOf(uint64_t hash) {
+        return static_cast<size_t>(hash >> 58);
+    }
+    static_assert(SEARCH_PARTITIONS == 64, "partitionOf takes six bits of the hash");
+
+    // The fewest commands the state has been reached with, or NOT_REACHED
+    uint32_t levelOf(const Partition& partition, const uint64_t* packed, uint64_t hash) const {
+        if (partition.slotCount == 0) {
+            return NOT_REACHED;
+        }
+        for (size_t slot = hash & (partition.slotCount - 1);; slot = (slot + 1) & (partition.slotCount - 1)) {
+            const uint64_t* stored = &partition.slots[slot * stateWords];
+            if (stored[0] == EMPTY_SLOT) {
+                return NOT_REACHED;
+            }
+            if (equal(stored, stored + stateWords, packed)) {
+                return partition.levels[slot];
+            }
+        }
+    }
+
+    // Adds the state to the partition, reached with level commands; returns false if it was reached with as few before
+    bool insert(Partition& partition, const uint64_t* packed, uint64_t hash, uint32_t level) const {
+        if ((partition.used + 1) * 4 > partition.slotCount * 3) {
+            Partition grown;
+            grown.slotCount = max(FIRST_SLOTS, partition.slotCount * 2);
+            grown.slots.assign(grown.slotCount * stateWords, 0);
+            grown.levels.assign(grown.slotCount, NOT_REACHED);
+            for (size_t slot = 0; slot < grown.slotCount; slot++) {
+                grown.slots[slot * stateWords] = EMPTY_SLOT;
+            }
+            for (size_t slot = 0; slot < partition.slotCount; slot++) {
+                const uint64_t* stored = &partition.slots[slot * stateWords];
+                if (stored[0] != EMPTY_SLOT) {
+                    insert(grown, stored, hashState(stored), partition.levels[slot]);
+                }
+            }
+            partition = std::move(grown);
+        }
+        size_t slot = hash & (partition.slotCount - 1);
+        for (; partition.slots[slot * stateWords] != EMPTY_SLOT; slot = (slot + 1) & (partition.slotCount - 1)) {
+            if (equal(packed, packed + stateWords, &partition.slots[slot * stateWords])) {
+                if (partition.levels[slot] <= level) {
+                    return false;
+                }
+                partition.levels[slot] = level;
+                return true;
+            }
+        }
+        copy_n(packed, stateWords, &partition.slots[slot * stateWords]);
+        partition.levels[slot] = level;
+        partition.used++;
+        return true;
+    }
+
+    /*
+    What a trigger needs before it ends the game: the rooms the player must be in and the items they must carry,
+    and whether it then wins or loses
+    */
+    struct Ending {
+        vector<uint32_t> rooms;
+        vector<uint32_t> items; // The symbols of their names
+        bool wins = false;
+    };
+
+    // Reads the conditions a trigger checks before it wins or loses; returns false if it never does either
+    bool readEnding(Span<Instruction> code, Ending& ending) const {
+        for (const auto& instruction : code) {
+            if (instruction.op == Op::RequireHolding) {
+                ending.items.push_back(instruction.operand);
+            } else if (instruction.op == Op::RequireIn) {
+                ending.rooms.push_back(instruction.operand);
+            } else if (instruction.op == Op::Win || instruction.op == Op::Lose) {
+                ending.wins = instruction.op == Op::Win;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+    Reads the triggers that can end the game when a room is entered or stayed in or an item is taken, in the order
+    the game runs them, and the items they need the player to carry (or, for a take trigger that wins, to take)
+    */
+    void readEndings() {
+        for (Event event : {TakeEvent, EnterEvent, TurnEvent}) {
+            uint32_t subjects = isRoomEvent(event) ? world.getRoomCount() : world.getSymbolCount();
+            for (uint32_t subject = 0; subject < subjects; subject++) {
+                for (const auto& trigger : world.getTriggers(event, subject)) {
+                    Ending ending;
+                    if (trigger.event != event || !readEnding(world.getCode(trigger), ending)) {
+                        continue;
+                    }
+                    neededItems.insert(ending.items.begin(), ending.items.end());
+                    if (event == TakeEvent && ending.wins) {
+                        neededItems.insert(subject);
+                    }
+                    endings[event][subject].push_back(ending);
+                }
+            }
+        }
+    }
+
+    // How the game goes when the event happens in the state: the first trigger whose conditions hold ends it
+    Outcome outcome(Event event, uint32_t subject, const State& state) const {
+        auto it = endings[event].find(subject);
+        if (it == endings[event].end()) {
+            return Continues;
+        }
+        int held = carried(state);
+        for (const auto& ending : it->second) {
+            bool holds = true;
+            for (uint32_t room : ending.rooms) {
+                holds = holds && state[0] == room;
+            }
+            for (const auto& item : ending.items) {
+                holds = holds && held >= 0 && itemNames[held] == item;
+            }
+            if (holds) {
+                return ending.wins ? Won : Lost;
+            }
+        }
+        return Continues;
+    }
+
+    // The needed item the player carries, or -1 if they carry none
+    int carried(const State& state) const {
+        for (size_t i = 1; i < state.size(); i++) {
+            if (state[i] == CARRIED) {
+                return static_cast<int>(i - 1);
+            }
+        }
+        return -1;
+    }
+
+    /*
+    Items with the same name can be swapped without changing the game, so their locations are kept sorted.
+    The carried item is kept by name, so taking either of two keys gives the same state
+    */
+    void sortSameItems(State& state) const {
+        size_t first = 0;
+        while (first < itemNames.size()) {
+            size_t last = first;
+            while (last < itemNames.size() && itemNames[last] == itemNames[first]) {
+                last++;
+            }
+            sort(state.begin() + first + 1, state.begin() + last + 1);
+            first = last;
+        }
+    }
+
+    const Control& game;
+    const World& world;
+    unordered_map<uint32_t, vector<Ending>> endings[EventCount]; // The triggers that end the game, by the index or symbol of their subject
+    unordered_set<uint32_t> neededItems;
+    vector<uint32_t> itemNames; // The symbol of the name of each needed item, in the order of the state
+    size_t statesExplored = 0;
+    size_t fieldBits = 0, fieldsPerWord = 0, stateWords = 0; // How states are packed
+    vector<Partition> partitions; // The states reached so far
+    vector<uint32_t> parents; // For each state reached, the number of the state it was reached from
+    vector<Command> moves; // and the command that reached it
+    vector<Goal> goals;
+    vector<uint32_t> landmarkRooms;
+    vector<vector<uint32_t>> movesTo; // For each landmark, the moves it takes to reach it from each room (NO_PATH if it cannot be)
+};
+
+/*
+Generator class writes a world file of any size. The same seed always gives the same world, because the random
+numbers come from mt19937 (which is the same everywhere) and are turned into choices without the standard distributions
+(which are not). Rooms are laid out on a square grid; every room is joined to the room west of it, or north of it
+at the start of a row, so the whole world is connected, and connectivity is the percent chance of each other grid
+neighbour being joined as well. The start room is room0, the last room is wonderland, and the key is in a random room
+*/
+class Generator {
+public:
+    Generator(size_t roomCount, unsigned int seed, size_t itemCount, size_t characterCount, unsigned int connectivity,
+              size_t wandererCount = 0)
+        : roomCount(max<size_t>(roomCount, 2)), itemCount(itemCount), characterCount(characterCount), connectivity(connectivity),
+          wandererCount(wandererCount), random(seed) {}
+
+    void write(ostream& world) {
+        size_t width = 1;
+        while (width * width < roomCount) {
+            width++;
+        }
+
+        for (size_t room = 0; room < roomCount; room++) {
+            world << "room " << roomName(room) << " You are in " << PLACES[pick(size(PLACES))] << ". "
+                  << DETAILS[pick(size(DETAILS))] << " " << SOUNDS[pick(size(SOUNDS))] << " The " << ADJECTIVES[pick(size(ADJECTIVES))]
+                  << " " << NOUNS[pick(size(NOUNS))] << " " << VERBS[pick(size(VERBS))] << " the " << ADJECTIVES[pick(size(ADJECTIVES))]
+                  << " " << NOUNS[pick(size(NOUNS))] << ".\n";
+        }
+        for (size_t room = 1; room < roomCount; room++) {
+            bool hasWest = room % width != 0;
+            bool hasNorth = room >= width;
+            if (hasWest) {
+                joinRooms(world, room - 1, "east", room, "west");
+            }
+            if (hasNorth && (!hasWest || chance(connectivity))) { // Rooms at the start of a row are always joined north
+                joinRooms(world, room - width, "south", room, "north");
+            }
+        }
+
+        world << "item " << roomName(pick(roomCount)) << " " << Generator::WIN_ITEM << "\n";
+        for (size_t item = 0; item < itemCount; item++) {
+            world << "item " << roomName(pick(roomCount)) << " item" << item << "\n";
+        }
+        for (size_t character = 0; character < characterCount; character++) {
+            string room = roomName(pick(roomCount));
+            world << "character " << room << " character" << character << " " << LINES[pick(size(LINES))] << "\n";
+            if (character < wandererCount) { // The first characters wander
+                world << "wander " << room << " character" << character << "\n";
+            }
+        }
+        world << "start " << roomName(0) << "\n";
+        world << "on turn " << WIN_LOCATION << "\n";
+        world << "    if holding " << WIN_ITEM << "\n";
+        world << "    say You win!\n";
+        world << "    win\n";
+    }
+
+    /*
+    The player wins by reaching this room while carrying this item
+    */
+    static constexpr const char* WIN_LOCATION = "wonderland";
+    static constexpr const char* WIN_ITEM = "key";
+
+private:
+    /*
+    The sentences room descriptions and dialogue are made from. Like a hand written world, rooms and characters say
+    things of a realistic length, and the same sentences come up again and again; but each room's description ends with
+    a sentence of words picked one by one, so that (as in a hand written world) hardly two rooms are described alike
+    */
+    static constexpr const char* PLACES[] = {
+        "a long hall lined with doors of every size, all of them locked",
+        "a garden where the gardeners are painting the white roses red",
+        "a dim kitchen full of pepper, where the cook is throwing saucepans",
+        "a wood so thick that the light comes through green and gold",
+        "a room where the tea table is laid for far more guests than have come",
+        "a courtyard paved with playing cards, every one of them face down",
+        "a hall of mirrors in which everything is the wrong way round",
+        "a meadow where the flowers talk among themselves about the weather",
+    };
+    static constexpr const char* DETAILS[] = {
+        "A small bottle on the table says DRINK ME in large letters.",
+        "The walls are covered with maps and pictures hung on pegs.",
+        "A little cake lies on a glass plate, with EAT ME marked in currants.",
+        "Somebody has left a pair of white kid gloves and a fan on the floor.",
+        "A pool of salt water fills one corner, with a mouse swimming in it.",
+        "A clock on the wall has stopped at six o'clock, and it is always tea time.",
+        "Tall mushrooms grow here, taller than you are.",
+        "A grin hangs in the air, long after the cat it belonged to has gone.",
+    };
+    static constexpr const char* SOUNDS[] = {
+        "You hear the patter of little feet hurrying away.",
+        "Somewhere close by, someone is reciting poetry all wrong.",
+        "A voice shouts 'Off with her head!' in the distance.",
+        "It is perfectly quiet, apart from the ticking of a watch.",
+        "You hear a kettle singing and the clink of teacups.",
+        "Leaves rustle as something large moves about behind you.",
+    };
+    static constexpr const char* ADJECTIVES[] = {
+        "little", "enormous", "curious", "sleepy", "grinning", "anxious", "mad", "solemn", "crooked", "golden", "painted",
+        "melancholy", "furious", "tiny", "ancient", "giddy", "velvet", "wooden", "silver", "hungry", "polite", "muddled",
+        "startled", "invisible", "shrinking", "peppery", "royal", "wobbly", "dreamy", "stubborn", "frantic", "patient",
+    };
+    static constexpr const char* NOUNS[] = {
+        "dormouse", "teapot", "flamingo", "hedgehog", "lobster", "caterpillar", "duchess", "treacle well", "pocket watch",
+        "looking glass", "rocking horse", "oyster", "gryphon", "jury box", "tart", "umbrella", "walrus", "carpenter",
+        "chess knight", "toadstool", "hookah", "rattle", "lion", "unicorn", "knave", "mock turtle", "porpoise", "whiting",
+        "gardener", "footman", "puppy", "pig",
+    };
+    static constexpr const char* VERBS[] = {
+        "argues with", "waltzes around", "bows politely to", "hides behind", "recites a poem to", "stares at",
+        "whispers to", "runs away from", "paints", "sings to", "naps beside", "quarrels with", "curtsies to",
+        "chases", "offers tea to", "tells riddles to",
+    };
+    static constexpr const char* LINES[] = {
+        "Oh dear! Oh dear! I shall be too late! Have you seen my gloves anywhere?",
+        "Why is a raven like a writing desk? I haven't the slightest idea either.",
+        "We're all mad here. I'm mad. You're mad. You must be, or you wouldn't have come here.",
+        "Curiouser and curiouser! Everything is queer today, and yesterday things went on just as usual.",
+        "If you don't know where you are going, any road will get you there.",
+        "Who are you? I hardly know, sir, just at present; I have changed several times since this morning.",
+        "It's always six o'clock now, so it's always tea time, and we've no time to wash the things between whiles.",
+        "Take some more tea. I've had nothing yet, so I can't take more. You mean you can't take less.",
+    };
+
+    string roomName(size_t room) const {
+        return room == roomCount - 1 ? string(Generator::WIN_LOCATION) : "room" + to_string(room);
+    }
+
+    void joinRooms(ostream& world, size_t from, const char* direction, size_t to, const char* back) {
+        world << "exit " << roomName(from) << " " << direction << " " << roomName(to) << "\n";
+        world << "exit " << roomName(to) << " " << back << " " << roomName(from) << "\n";
+    }
+
+    // Picks a number from 0 to count - 1; the two draws are separate statements so they happen in the same order everywhere
+    size_t pick(size_t count) {
+        uint64_t high = random();
+        uint64_t low = random();
+        return static_cast<size_t>((high << 32 | low) % count);
+    }
+
+    bool chance(unsigned int percent) {
+        return pick(100) < percent;
+    }
+
+    size_t roomCount;
+    size_t itemCount;
+    size_t characterCount;
+    unsigned int connectivity;
+    size_t wandererCount;
+    mt19937 random;
+};
+
+/*
+Benchmark class measures how fast commands are parsed, then generates worlds of each size and measures how long they
+take to load, how much memory each room uses, how many bytes its texts take before and after they are compressed, how
+long each kind of command takes, how long a room takes to render (in order, and far apart so its block is decompressed),
+and how many commands a second players on 1, 2, 4 and more threads manage when they share the world.
+Each world is written to a temporary file, compiled into an image and loaded from the image, which is mapped rather
+than read. Compiling holds the whole world in memory, so a million rooms is the largest size it is meant for
+*/
+class Benchmark {
+public:
+    Benchmark(const vector<size_t>& roomCounts) : roomCounts(roomCounts) {}
+
+    void run() {
+        measureParsing(PARSES);
+        measureTicks();
+        for (size_t roomCount : roomCounts) {
+            measure(roomCount);
+        }
+    }
+
+    /*
+    Parses a mix of commands over and over, on its own, so the time is only the parser's and not the game's. Each
+    command is parsed, and a move's direction found, the way the original game did it (copying the words out and
+    lowercasing them), by comparing the words with each keyword in turn, and by KEYWORD_TABLE, as the game now does,
+    so the three can be compared on the same machine
+    */
+    static void measureParsing(size_t parses) {
+        measureParser("copies", parses, [](const string& action, string& word) {
+            if (action.substr(0, 5) == "take ") {
+                word = action.substr(5);
+                return word.size();
+            } else if (action.substr(0, 6) == "leave ") {
+                word = action.substr(6);
+                return word.size();
+            } else if (action.substr(0, 5) == "talk ") {
+                word = action.substr(5);
+                return word.size();
+            }
+            word = action;
+            transform(word.begin(), word.end(), word.begin(), ::tolower);
+            for (int direction = 0; direction < DirectionCount; direction++) {
+                string name(DIRECTION_NAMES[direction]);
+                if (word == name || word == name.substr(0, 1)) {
+                    return word.size() + direction;
+                }
+            }
+            return word.size() + DirectionCount;
+        });
+        measureParser("scan", parses, [](const string& action, string&) {
+            static const pair<string_view, Verb> verbs[] = {{"take", Verb::Take}, {"leave", Verb::Leave}, {"talk", Verb::Talk}};
+            string_view text = trim(action);
+            size_t space = text.find_first_of(" \t");
+            if (space != string_view::npos) {
+                for (const auto& verb : verbs) {
+                    if (equalsIgnoreCase(text.substr(0, space), verb.first)) {
+                        return trim(text.substr(space)).size();
+                    }
+                }
+            } else if (equalsIgnoreCase(text, "stats")) {
+                return size_t(0);
+            }
+            int direction = 0;
+            for (; direction < DirectionCount; direction++) {
+                string_view name = DIRECTION_NAMES[direction];
+                if (equalsIgnoreCase(text, name) || (text.length() == 1 && equalsIgnoreCase(text, name.substr(0, 1)))) {
+                    break;
+                }
+            }
+            return text.size() + direction;
+        });
+        measureParser("table", parses, [](const string& action, string&) {
+            Command command = parseCommand(action);
+            return command.argument.size() + (command.verb == Verb::Move ? parseDirection(command.argument) : 0);
+        });
+    }
+
+private:
+    enum Kind { MoveCommand, TakeCommand, LeaveCommand, TalkCommand, KindCount };
+
+    template <typename Parser>
+    static void measureParser(const char* name, size_t parses, Parser parse) {
+        static const string commands[] = {
+            "north", "s", "take key", "leave key", "talk caterpillar", "  TAKE   chronosphere  ", "stats", "jump",
+        };
+        string word; // The copying parser's words, kept between commands as the original game kept its strings
+        size_t parsed = 0; // Used after the loop so the parsing cannot be left out by the compiler
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < parses; i++) {
+            parsed += parse(commands[i % size(commands)], word);
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "parse (" << name << "): " << seconds * 1e9 / parses << " ns/command, "
+             << static_cast<long long>(parses / seconds) << " commands/s (" << parsed << ")\n";
+    }
+
+    /*
+    Moves the wandering characters of a generated world with TICK_WANDERERS of them, tick after tick, as a world shared
+    by many players is ticked
+    */
+    void measureTicks() {
+        string worldFile = (filesystem::temp_directory_path() / "alice_bench_ticks.txt").string();
+        {
+            ofstream world(worldFile);
+            Generator(TICK_ROOMS, 1, 0, TICK_WANDERERS, 50, TICK_WANDERERS).write(world);
+        }
+        ostringstream messages;
+        World world(worldFile, messages);
+        filesystem::remove(worldFile);
+        WorldChanges changes(world, WorldChanges::SHARED_SHARDS);
+        auto start = chrono::steady_clock::now();
+        for (size_t tick = 0; tick < TICKS; tick++) {
+            changes.tick();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "tick: " << changes.getWandererCount() << " wanderers in " << world.getRoomCount() << " rooms, "
+             << seconds * 1000 / TICKS << " ms/tick, in batches spread over " << WorkerPool::shared().getThreadCount()
+             << (WorkerPool::shared().getThreadCount() == 1 ? " thread\n" : " threads\n");
+    }
+
+    void measure(size_t roomCount) {
+        string worldFile = (filesystem::temp_directory_path() / ("alice_bench_" + to_string(roomCount) + ".txt")).string();
+        string imageFile = (filesystem::temp_directory_path() / ("alice_bench_" + to_string(roomCount) + ".img")).string();
+        {
+            ofstream world(worldFile);
+            Generator(roomCount, 1, roomCount, roomCount / 10 + 1, 50).write(world);
+        }
+        auto compileStart = chrono::steady_clock::now();
+        {
+            ifstream text(worldFile);
+            WorldCompiler compiler;
+            compiler.read(text, worldFile, cerr);
+            compiler.write(imageFile);
+        }
+        double compileSeconds = chrono::duration<double>(chrono::steady_clock::now() - compileStart).count();
+        filesystem::remove(worldFile);
+
+        istringstream commands;
+        ostringstream transcript;
+        long memoryBefore = residentMemory();
+        auto loadStart = chrono::steady_clock::now();
+        World world(imageFile, transcript);
+        WorldChanges changes(world, WorldChanges::SHARED_SHARDS);
+        Control game(changes, commands, transcript);
+        double loadSeconds = chrono::duration<double>(chrono::steady_clock::now() - loadStart).count();
+        long memoryAfter = residentMemory();
+        filesystem::remove(imageFile); // The mapping keeps the image until the world is gone
+
+        // Each room is rendered from the image, as a player sees it when they first come in
+        size_t rendered = min<size_t>(world.getRoomCount(), COMMANDS);
+        string text;
+        auto renderStart = chrono::steady_clock::now();
+        for (uint32_t room = 0; room < rendered; room++) {
+            lock_guard<mutex> guard(changes.shardOf(room));
+            changes.render(room, text);
+        }
+        double renderSeconds = chrono::duration<double>(chrono::steady_clock::now() - renderStart).count();
+
+        // Then rooms far apart, whose blocks are mostly not in the cache, as players spread over the world see them
+        mt19937 random(1);
+        auto scatteredStart = chrono::steady_clock::now();
+        for (size_t i = 0; i < rendered; i++) {
+            uint32_t room = static_cast<uint32_t>(random() % world.getRoomCount());
+            lock_guard<mutex> guard(changes.shardOf(room));
+            changes.render(room, text);
+        }
+        double scatteredSeconds = chrono::duration<double>(chrono::steady_clock::now() - scatteredStart).count();
+        World::TextBytes textBytes = world.measureTexts();
+
+        vector<double> latencies[KindCount];
+        for (size_t i = 0; i < COMMANDS; i++) {
+            Kind kind;
+            string command = nextCommand(game, random, kind);
+            commands.clear();
+            commands.str(command + "\n");
+            transcript.str("");
+            auto turnStart = chrono::steady_clock::now();
+            game.playTurn();
+            latencies[kind].push_back(chrono::duration<double, micro>(chrono::steady_clock::now() - turnStart).count());
+        }
+
+        cout << roomCount << " rooms: compile " << compileSeconds * 1000 << " ms, load " << loadSeconds * 1000 << " ms, image "
+             << world.getImageSize() / roomCount << " bytes/room, memory "
+             << (memoryAfter - memoryBefore) / static_cast<long>(roomCount) << " bytes/room, render "
+             << renderSeconds * 1e6 / max<size_t>(rendered, 1) << " us/room in order, "
+             << scatteredSeconds * 1e6 / max<size_t>(rendered, 1) << " us/room scattered, text " << textBytes.used / roomCount
+             << " bytes/room shown, " << textBytes.unique / roomCount << " once each, " << textBytes.stored / roomCount << " compressed";
+        const char* names[KindCount] = {"move", "take", "leave", "talk"};
+        for (int kind = 0; kind < KindCount; kind++) {
+            sort(latencies[kind].begin(), latencies[kind].end());
+            cout << ", " << names[kind] << " p50 " << percentile(latencies[kind], 0.50)
+                 << " us p99 " << percentile(latencies[kind], 0.99) << " us";
+        }
+        // Then 1, 2, 4 and more players, up to one for every core (and at least four), each on a thread of their own
+        unsigned int cores = max(1u, thread::hardware_concurrency());
+        double alone = playTogether(changes, 1);
+        cout << ", shared world on " << cores << " cores: 1 thread " << static_cast<long long>(alone) << " commands/s";
+        for (unsigned int players = 2; players <= max(4u, cores); players *= 2) {
+            double together = playTogether(changes, players);
+            cout << ", " << players << " threads " << static_cast<long long>(together) << " commands/s ("
+                 << together / (alone * min(players, cores)) * 100 << "% of linear)";
+        }
+        cout << ", " << SESSIONS << " sessions " << measureSessions(world) << " bytes/session\n";
+    }
+
+    /*
+    Starts SESSIONS sessions that each play the world with changes of their own, as the server's sessions do, and plays a
+    few commands in each; returns the memory each session takes
+    */
+    static long measureSessions(const World& world) {
+        istringstream commands;
+        ostringstream transcript;
+        long memoryBefore = heapInUse();
+        vector<unique_ptr<Control>> sessions;
+        mt19937 random(1);
+        for (size_t i = 0; i < SESSIONS; i++) {
+            Control& session = *sessions.emplace_back(make_unique<Control>(world, commands, transcript));
+            for (size_t turn = 0; turn < SESSION_COMMANDS && session.prompt(); turn++) {
+                Kind kind;
+                session.handleLine(nextCommand(session, random, kind));
+                transcript.str("");
+            }
+        }
+        return (heapInUse() - memoryBefore) / static_cast<long>(SESSIONS);
+    }
+
+    /*
+    Plays the shared world with the given number of players at once, each on a thread of their own, and returns how many
+    commands a second they played between them
+    */
+    static double playTogether(WorldChanges& changes, unsigned int players) {
+        vector<thread> threads;
+        auto start = chrono::steady_clock::now();
+        for (unsigned int player = 0; player < players; player++) {
+            threads.emplace_back([&changes, player] {
+                istringstream commands;
+                ostringstream transcript;
+                Control game(changes, commands, transcript);
+                mt19937 random(player + 1);
+                for (size_t i = 0; i < SHARED_COMMANDS; i++) {
+                    Kind kind;
+                    string command;
+                    {
+                        lock_guard<mutex> guard(changes.shardOf(game.getCurrentRoom())); // The other players change the room too
+                        command = nextCommand(game, random, kind);
+                    }
+                    commands.clear();
+                    commands.str(command + "\n");
+                    transcript.str("");
+                    game.playTurn();
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return players * SHARED_COMMANDS / seconds;
+    }
+
+    /*
+    Chooses a command that works in the player's room, so each kind of command is measured doing its real work.
+    The key is never taken, so the game never ends part way through
+    */
+    static string nextCommand(const Control& game, mt19937& random, Kind& kind) {
+        const WorldChanges& changes = game.getChanges();
+        const World& world = game.getWorld();
+        uint32_t room = game.getCurrentRoom();
+        if (!game.getInventory().empty()) {
+            kind = random() % 2 ? LeaveCommand : MoveCommand;
+            if (kind == LeaveCommand) {
+                return "leave " + string(world.getName(game.getInventory().front().getName()));
+            }
+        } else if (changes.itemCount(room) != 0 && random() % 2) {
+            size_t skip = random() % changes.itemCount(room);
+            string item;
+            changes.forEachItem(room, [&](uint32_t itemName) {
+                if (skip-- == 0) {
+                    item = world.getName(itemName);
+                }
+            });
+            if (item != Generator::WIN_ITEM) {
+                kind = TakeCommand;
+                return "take " + item;
+            }
+        } else {
+            vector<uint32_t> characters;
+            changes.forEachCharacter(room, [&](const Character& character) {
+                characters.push_back(character.name);
+            });
+            if (!characters.empty() && random() % 2) {
+                kind = TalkCommand;
+                return "talk " + string(world.getName(characters[random() % characters.size()]));
+            }
+        }
+
+        kind = MoveCommand;
+        vector<int> exits;
+        for (int direction = 0; direction < DirectionCount; direction++) {
+            if (world.getExit(room, static_cast<Direction>(direction)) != NO_ROOM) {
+                exits.push_back(direction);
+            }
+        }
+        return exits.empty() ? "north" : string(DIRECTION_NAMES[exits[random() % exits.size()]]);
+    }
+
+    /*
+    The bytes of the heap in use. The resident memory does not grow while freed memory is used again, so small objects
+    made after a large world has been compiled are measured here instead; without glibc it is the resident memory
+    */
+    static long heapInUse() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+        struct mallinfo2 heap = mallinfo2();
+        return static_cast<long>(heap.uordblks + heap.hblkhd);
+#else
+        return residentMemory();
+#endif
+    }
+
+    // The resident memory of the process in bytes, or 0 where /proc is not available
+    static long residentMemory() {
+        ifstream status("/proc/self/status");
+        string line;
+        while (getline(status, line)) {
+            if (line.compare(0, 6, "VmRSS:") == 0) {
+                return stol(line.substr(6)) * 1024;
+            }
+        }
+        return 0;
+    }
+
+    static constexpr size_t COMMANDS = 100000; // Commands played in each world
+    static constexpr size_t SHARED_COMMANDS = 100000; // Commands each player plays in a shared world
+    static constexpr size_t PARSES = 10000000; // Commands parsed when measuring the parser
+    static constexpr size_t SESSIONS = 10000; // Sessions started when measuring their memory
+    static constexpr size_t TICK_ROOMS = 100000; // The world whose wandering characters are moved
+    static constexpr size_t TICK_WANDERERS = 200000;
+    static constexpr size_t TICKS = 100;
+    static constexpr size_t SESSION_COMMANDS = 10; // Commands played in each of them
+
+    vector<size_t> roomCounts;
+};
+
+/*
+AllocationCheck plays one session over and over with a round of commands that uses every kind of command: moving,
+taking and leaving items, talking (with the map), statistics, and commands that fail. Starting the session in the
+default world must not allocate any memory, since its world is compiled with the game. The first round sets up
+everything the session keeps from turn to turn; after that, playing a turn must not allocate any memory either
+*/
+class AllocationCheck {
+public:
+    AllocationCheck(size_t rounds) : rounds(max<size_t>(rounds, 1)) {}
+
+    // Returns false if starting the session or any turn after the first round allocated memory, or if allocations are not being counted
+    bool run() {
+#ifndef COUNT_ALLOCATIONS
+        cout << "Allocations are only counted when the game is compiled with -DCOUNT_ALLOCATIONS.\n";
+        return false;
+#else
+        if (!countsEveryForm()) {
+            cout << "Some forms of new are not counted, so the check cannot be trusted.\n";
+            return false;
+        }
+        string script;
+        for (size_t round = 0; round <= rounds; round++) {
+            script += ROUND;
+        }
+        istringstream commands(script);
+        DiscardingBuffer discarded;
+        ostream transcript(&discarded);
+        size_t beforeStart = allocationCount;
+        Control game(commands, transcript);
+        size_t startAllocations = allocationCount - beforeStart;
+        cout << "starting a session in the default world made " << startAllocations << " allocations\n";
+        size_t firstRound = count(begin(ROUND), end(ROUND), '\n');
+        for (size_t turn = 0; turn < firstRound; turn++) {
+            game.playTurn();
+        }
+
+        size_t before = allocationCount;
+        size_t turns = 0;
+        while (game.playTurn()) {
+            turns++;
+        }
+        size_t allocations = allocationCount - before;
+        cout << turns << " turns made " << allocations << " allocations\n";
+        return startAllocations == 0 && allocations == 0 && turns == rounds * firstRound;
+#endif
+    }
+
+private:
+#ifdef COUNT_ALLOCATIONS
+    /*
+    Makes one allocation with each form of new (plain, array, aligned and aligned array) and checks that each was
+    counted. The pointers go through a volatile so the compiler cannot leave the allocations out
+    */
+    static bool countsEveryForm() {
+        struct alignas(64) Aligned {
+            char bytes[64];
+        };
+        static void* volatile kept;
+        (void)kept;
+        size_t before = allocationCount;
+        char* plain = new char;
+        kept = plain;
+        delete plain;
+        char* array = new char[2];
+        kept = array;
+        delete[] array;
+        Aligned* aligned = new Aligned;
+        kept = aligned;
+        delete aligned;
+        Aligned* alignedArray = new Aligned[2];
+        kept = alignedArray;
+        delete[] alignedArray;
+        return allocationCount - before == 4;
+    }
+#endif
+
+    // One round, which starts and ends in the hole with every item back where it was
+    static constexpr char ROUND[] =
+        "n\nw\ntalk hatter\ntalk rabbit\ntalk nobody\ne\ne\nn\ntake hat\ntake key\ns\nleave hat\ntake hat\nn\n"
+        "leave hat\nleave hat\ntake nothing\ns\ns\ntalk caterpillar\nn\nup\nstats\nw\ns\n";
+
+    size_t rounds;
+};
+
+/*
+With no arguments the game is played interactively in world.txt (or in the world file or image given by "--world <file>");
+"--compile <world file> <image>" compiles a world into an image that loads without being read;
+"--replay [--record] [--world <file>] <script or directory>..." plays command scripts instead (in the default world, unless a world file is given),
+"--solve [world file]" prints the shortest winning commands as a script that --replay can play,
+"--generate <rooms> [seed] [items] [characters] [connectivity] [wanderers]" prints a generated world file,
+"--serve <socket> [--world <file>] [--shared | --journals <directory>] [--stats <file>]" plays a game for each player who
+connects to the local socket, each with a world of their own (saving each game in the directory, under the name the player
+sends first), or all of them in one world with --shared,
+"--bench <rooms>..." measures the game on generated worlds of each size,
+"--bench-parser [commands]" compares the game's parser with the ways commands were parsed before,
+"--check-allocations [rounds]" checks that starting a game and its turns do not allocate memory,
+and "--journal <file>" plays interactively, saving the game to the file and resuming it from there;
+"--stats <file>" also writes the game's statistics to the file every few seconds as it is played
+*/
+int main(int argc, char* argv[]) {
+    if (argc > 2 && string(argv[1]) == "--replay") {
+        bool record = false;
+        string worldFile;
+        int first = 2; // The first script or directory
+        for (; first < argc; first++) {
+            if (string(argv[first]) == "--record") {
+                record = true;
+            } else if (string(argv[first]) == "--world" && first + 1 < argc) {
+                worldFile = argv[++first];
+            } else {
+                break;
+            }
+        }
+        Replay replay(vector<string>(argv + first, argv + argc), record, worldFile);
+        return replay.run() ? 0 : 1;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--generate") {
+        Generator generator(stoul(argv[2]), argc > 3 ? stoul(argv[3]) : 1, argc > 4 ? stoul(argv[4]) : stoul(argv[2]),
+                            argc > 5 ? stoul(argv[5]) : stoul(argv[2]) / 10 + 1, argc > 6 ? stoul(argv[6]) : 50,
+                            argc > 7 ? stoul(argv[7]) : 0);
+        generator.write(cout);
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--bench-parser") {
+        Benchmark::measureParsing(argc > 2 ? stoul(argv[2]) : 10000000);
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--bench") {
+        vector<size_t> roomCounts;
+        for (int i = 2; i < argc; i++) {
+            roomCounts.push_back(stoul(argv[i]));
+        }
+        Benchmark benchmark(roomCounts);
+        benchmark.run();
+        return 0;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--check-allocations") {
+        AllocationCheck check(argc > 2 ? stoul(argv[2]) : 500);
+        return check.run() ? 0 : 1;
+    }
+
+    if (argc > 1 && string(argv[1]) == "--solve") {
+        Control game(cin, cerr, argc > 2 ? argv[2] : "world.txt");
+        Solver solver(game);
+        string problem = solver.unsupported();
+        if (!problem.empty()) {
+            cerr << "The world cannot be solved: " << problem << ".\n";
+            return 2;
+        }
+        vector<string> commands;
+        if (!solver.solve(commands)) {
+            cerr << "The world cannot be won (" << solver.getStatesExplored() << " states searched).\n";
+            return 1;
+        }
+        for (const auto& command : commands) {
+            cout << command << '\n';
+        }
+        cerr << "The world can be won in " << commands.size() << " commands (" << solver.getStatesExplored() << " states searched).\n";
+        return 0;
+    }
+
+    if (argc > 2 && string(argv[1]) == "--serve") {
+#ifdef __linux__
+        string worldFile = "world.txt", journalDirectory, statsFile;
+        bool shared = false;
+        for (int i = 3; i < argc; i++) {
+            if (string(argv[i]) == "--shared") {
+                shared = true;
+            } else if (string(argv[i]) == "--world" && i + 1 < argc) {
+                worldFile = argv[++i];
+            } else if (string(argv[i]) == "--journals" && i + 1 < argc) {
+                journalDirectory = argv[++i];
+            } else if (string(argv[i]) == "--stats" && i + 1 < argc) {
+                statsFile = argv[++i];
+            }
+        }
+        if (shared && !journalDirectory.empty()) {
+            cerr << "Games in a shared world are not saved, so --journals cannot be used with --shared.\n";
+            return 1;
+        }
+        error_code error;
+        if (!journalDirectory.empty() && !filesystem::is_directory(journalDirectory)
+            && !filesystem::create_directories(journalDirectory, error)) {
+            cerr << "Unable to make the directory " << journalDirectory << " for saved games.\n";
+            return 1;
+        }
+        World world(worldFile, cerr);
+        Server server(world, argv[2], thread::hardware_concurrency(), journalDirectory, shared);
+        optional<StatsWriter> stats;
+        if (!statsFile.empty()) {
+            stats.emplace(statsFile); // The statistics of every session, summed over the workers
+        }
+        if (!server.run()) {
+            cerr << "Unable to listen on " << argv[2] << ".\n";
+            return 1;
+        }
+        return 0;
+#else
+        cerr << "The server is only available on Linux.\n";
+        return 1;
+#endif
+    }
+
+    if (argc > 3 && string(argv[1]) == "--compile") {
+        ifstream text(argv[2]);
+        WorldCompiler compiler;
+        if (!text.is_open()) {
+            cerr << "Unable to open " << argv[2] << ".\n";
+            return 1;
+        }
+        if (!compiler.read(text, argv[2], cerr)) {
+            cerr << argv[2] << " has no rooms.\n";
+            return 1;
+        }
+        if (!compiler.write(argv[3])) {
+            cerr << "Unable to write " << argv[3] << ".\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    string worldFile = "world.txt", journalFile, statsFile;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (string(argv[i]) == "--world") {
+            worldFile = argv[i + 1];
+        } else if (string(argv[i]) == "--journal") {
+            journalFile = argv[i + 1];
+        } else if (string(argv[i]) == "--stats") {
+            statsFile = argv[i + 1];
+        }
+    }
+
     Game game; 
-    game.run(); // The game is run
+    game.run(worldFile, journalFile, statsFile); // The game is run
     return 0;
 }